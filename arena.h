@@ -0,0 +1,115 @@
+#pragma once
+
+#include "unique.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Monotonic region: allocation bumps a pointer through a chain of chunks, nothing is freed
+// one by one. Reset() gives all memory back at once, keeping the newest chunk for reuse.
+//
+// Objects made with MakeUniqueIn() are owned by a UniquePtr with an ArenaDeleter, which only
+// runs the destructor; the arena has to be reset (or destroyed) after those pointers die.
+class Arena {
+public:
+    static constexpr size_t kMinChunkSize = 4096;
+    static constexpr size_t kMaxChunkSize = 1 << 20;
+
+    Arena() = default;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        FreeChunks(nullptr);
+    }
+
+    // `alignment` must be a power of two.
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        if (!head_ || AlignedOffset(alignment) + size > head_->size) {
+            AddChunk(size + alignment);
+        }
+        size_t offset = AlignedOffset(alignment);
+        used_ = offset + size;
+        return reinterpret_cast<unsigned char*>(head_) + offset;
+    }
+
+    template <typename T, typename... Args>
+    T* Create(Args&&... args) {
+        return ::new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Release everything allocated so far. Objects still living here are not destroyed.
+    void Reset() {
+        if (head_) {
+            FreeChunks(head_);
+            head_->previous = nullptr;
+            used_ = sizeof(Chunk);
+        }
+    }
+
+private:
+    struct Chunk {
+        Chunk* previous;
+        size_t size;  // Including this header.
+    };
+
+    // Offset of the first free byte in the current chunk that is suitably aligned.
+    size_t AlignedOffset(size_t alignment) const {
+        uintptr_t base = reinterpret_cast<uintptr_t>(head_);
+        return ((base + used_ + alignment - 1) & ~(alignment - 1)) - base;
+    }
+
+    void AddChunk(size_t min_size) {
+        size_t size = head_ ? head_->size * 2 : kMinChunkSize;
+        if (size > kMaxChunkSize) {
+            size = kMaxChunkSize;
+        }
+        if (size < sizeof(Chunk) + min_size) {
+            size = sizeof(Chunk) + min_size;
+        }
+        head_ = ::new (::operator new(size)) Chunk{head_, size};
+        used_ = sizeof(Chunk);
+    }
+
+    // Free the chunks older than `keep`, or all of them.
+    void FreeChunks(Chunk* keep) {
+        Chunk* chunk = keep ? keep->previous : head_;
+        while (chunk) {
+            Chunk* previous = chunk->previous;
+            ::operator delete(chunk);
+            chunk = previous;
+        }
+    }
+
+    Chunk* head_ = nullptr;
+    size_t used_ = 0;
+};
+
+// Deleter for objects living in an Arena: runs the destructor, if there is one to run,
+// and leaves the memory to the arena. Stateless, so UniquePtr stays a single pointer.
+template <typename T>
+struct ArenaDeleter {
+    ArenaDeleter() = default;
+
+    template <typename U>
+    ArenaDeleter(const ArenaDeleter<U>&) {
+    }
+
+    void operator()(T* ptr) {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            ptr->~T();
+        }
+    }
+};
+
+template <typename T>
+using ArenaPtr = UniquePtr<T, ArenaDeleter<T>>;
+
+template <typename T, typename... Args>
+ArenaPtr<T> MakeUniqueIn(Arena& arena, Args&&... args) {
+    return ArenaPtr<T>(arena.Create<T>(std::forward<Args>(args)...));
+}
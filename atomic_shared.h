@@ -0,0 +1,163 @@
+#pragma once
+
+#include "shared.h"
+
+#include <atomic>
+#include <cstdint>
+
+// A SharedPtr slot that may be loaded, stored and swapped concurrently without locks.
+//
+// The slot points to an immutable node holding the published SharedPtr, and uses split
+// reference counting for it: the high 16 bits of the slot word count readers that are
+// borrowing the current node. A reader takes a loan with a single fetch_add, copies the
+// SharedPtr out and pays the loan back with a CAS. A writer swapping the node out converts
+// the outstanding loans into the node's own counter, so late readers settle up there.
+// Readers never touch the node counter while the node stays published.
+//
+// Loans only live for the duration of one Load() or CompareExchange(), so the 16 bits
+// bound the number of threads inside those calls at once, not the number of loads.
+template <typename T>
+class AtomicSharedPtr {
+public:
+    using Value = SharedPtr<T, MultiThreaded>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    AtomicSharedPtr() noexcept : slot_(0) {
+    }
+
+    AtomicSharedPtr(Value desired) : slot_(MakeWord(MakeNode(std::move(desired)), 0)) {
+    }
+
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+    AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~AtomicSharedPtr() {
+        uint64_t word = slot_.load(std::memory_order_acquire);
+        Retire(GetNode(word), GetLoans(word));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Atomic operations
+    Value Load() const {
+        Node* node = Borrow();
+        Value value = node ? node->value : Value();
+        Repay(node);
+        return value;
+    }
+
+    void Store(Value desired) {
+        Exchange(std::move(desired));
+    }
+
+    Value Exchange(Value desired) {
+        uint64_t old = slot_.exchange(MakeWord(MakeNode(std::move(desired)), 0),
+                                      std::memory_order_acq_rel);
+        Node* node = GetNode(old);
+        Value value = node ? node->value : Value();
+        Retire(node, GetLoans(old));
+        return value;
+    }
+
+    // Replace the value with `desired` if it is the same pointer as `expected`,
+    // otherwise load the current value into `expected`.
+    bool CompareExchange(Value& expected, Value desired) {
+        Node* desired_node = MakeNode(std::move(desired));
+        while (true) {
+            Node* node = Borrow();
+            Value current = node ? node->value : Value();
+            if (current.Get() != expected.Get() || current.block_ != expected.block_) {
+                Repay(node);
+                ReleaseNode(desired_node, kSlotReference);
+                expected = std::move(current);
+                return false;
+            }
+            uint64_t word = slot_.load(std::memory_order_relaxed);
+            while (GetNode(word) == node) {
+                if (slot_.compare_exchange_weak(word, MakeWord(desired_node, 0),
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed)) {
+                    // Our own loan is among the recorded ones, settle it right away.
+                    Retire(node, GetLoans(word) - 1);
+                    return true;
+                }
+            }
+            // Somebody swapped the node under us and converted our loan.
+            ReleaseNode(node, 1);
+        }
+    }
+
+    bool IsLockFree() const noexcept {
+        return slot_.is_lock_free();
+    }
+
+private:
+    // The slot's reference to its node outweighs any number of loans, so readers that
+    // repay early can't free the node before the writer has converted the loans.
+    static constexpr size_t kSlotReference = size_t{1} << 16;
+
+    struct Node {
+        explicit Node(Value value) : value(std::move(value)) {
+        }
+
+        const Value value;
+        std::atomic<size_t> references{kSlotReference};
+    };
+
+    static constexpr int kLoanShift = 48;
+    static constexpr uint64_t kLoanOne = uint64_t{1} << kLoanShift;
+    static constexpr uint64_t kNodeMask = kLoanOne - 1;
+
+    static_assert(sizeof(Node*) == sizeof(uint64_t), "the slot packs a 48-bit node address");
+
+    static Node* MakeNode(Value value) {
+        return value ? new Node(std::move(value)) : nullptr;
+    }
+
+    static uint64_t MakeWord(Node* node, uint64_t loans) {
+        return reinterpret_cast<uintptr_t>(node) | (loans << kLoanShift);
+    }
+
+    static Node* GetNode(uint64_t word) {
+        return reinterpret_cast<Node*>(static_cast<uintptr_t>(word & kNodeMask));
+    }
+
+    static uint64_t GetLoans(uint64_t word) {
+        return word >> kLoanShift;
+    }
+
+    // Take a loan on the published node, keeping it alive until Repay(). Loans on an empty
+    // slot are recorded as well, so Repay() doesn't need to tell the two cases apart.
+    Node* Borrow() const {
+        return GetNode(slot_.fetch_add(kLoanOne, std::memory_order_acquire));
+    }
+
+    void Repay(Node* node) const {
+        uint64_t word = slot_.load(std::memory_order_relaxed);
+        // A node can't be reused while we hold a loan on it, so a matching
+        // address means the loan is still recorded in the slot.
+        while (GetNode(word) == node && GetLoans(word) != 0) {
+            if (slot_.compare_exchange_weak(word, word - kLoanOne, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        ReleaseNode(node, 1);
+    }
+
+    // Settle a node that has just been swapped out: the slot's reference is traded
+    // for one node reference per outstanding loan.
+    static void Retire(Node* node, uint64_t loans) {
+        ReleaseNode(node, kSlotReference - loans);
+    }
+
+    static void ReleaseNode(Node* node, size_t count) {
+        if (node && node->references.fetch_sub(count, std::memory_order_acq_rel) == count) {
+            delete node;
+        }
+    }
+
+    mutable std::atomic<uint64_t> slot_;
+};
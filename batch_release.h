@@ -0,0 +1,109 @@
+#pragma once
+
+#include "intrusive.h"
+#include "shared.h"
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+// Releasing a large container of pointers one destructor at a time waits on a cache miss per
+// control block (or per intrusive object) when they are scattered over the heap.
+// ReleaseAll() empties the pointers in batches instead: it prefetches the blocks of one
+// batch while dropping the references of the previous one, so the misses overlap.
+// With blocks laid out in order the hardware prefetcher already does this, and ReleaseAll()
+// costs about the same as destroying the pointers one by one.
+//
+// Every pointer in the range is left empty; the order in which objects die is unspecified.
+class BatchReleaser {
+public:
+    // Pointers taken out per batch, i.e. how far ahead the prefetches run.
+    static constexpr size_t kBatch = 16;
+
+    template <typename T, typename Policy, typename Iterator>
+    static void Release(Iterator first, Iterator last, SharedPtr<T, Policy>*) {
+        using Block = ControlBlockBase<Policy>;
+        Batch<Block> batch;
+        do {
+            batch.Fill(first, last, [](SharedPtr<T, Policy>& ptr) {
+                ptr.observed_ = nullptr;
+                return std::exchange(ptr.block_, nullptr);
+            });
+            batch.ReleasePrevious([](Block* block) { block->Release(); });
+        } while (!batch.Done(first, last));
+    }
+
+    // The start of the object, where RefCounted's counter usually is, gets prefetched.
+    template <typename T, typename Iterator>
+    static void Release(Iterator first, Iterator last, IntrusivePtr<T>*) {
+        Batch<T> batch;
+        do {
+            batch.Fill(first, last, [](IntrusivePtr<T>& ptr) {
+                return std::exchange(ptr.ptr_, nullptr);
+            });
+            batch.ReleasePrevious([](T* object) { object->DecRef(); });
+        } while (!batch.Done(first, last));
+    }
+
+private:
+    static void Prefetch(const void* address) {
+#if defined(__GNUC__)
+        __builtin_prefetch(address, 1);
+#else
+        static_cast<void>(address);
+#endif
+    }
+
+    // Two halves: the one being filled and prefetched, and the previous one, released
+    // after the fill so that its prefetches had time to land.
+    template <typename Target>
+    class Batch {
+    public:
+        template <typename Iterator, typename Take>
+        void Fill(Iterator& first, Iterator last, Take take) {
+            std::swap(next_, previous_);
+            std::swap(next_size_, previous_size_);
+            next_size_ = 0;
+            for (; first != last && next_size_ < kBatch; ++first) {
+                if (Target* target = take(*first)) {
+                    Prefetch(target);
+                    next_[next_size_++] = target;
+                }
+            }
+        }
+
+        // A target only dies on its last reference, so no later entry of the half can
+        // still point to it and `release` may destroy it right away.
+        template <typename Release>
+        void ReleasePrevious(Release release) {
+            for (size_t i = 0; i < previous_size_; ++i) {
+                release(previous_[i]);
+            }
+            previous_size_ = 0;
+        }
+
+        template <typename Iterator>
+        bool Done(const Iterator& first, const Iterator& last) const {
+            return first == last && next_size_ == 0;
+        }
+
+    private:
+        Target* halves_[2][kBatch];
+        Target** next_ = halves_[0];
+        Target** previous_ = halves_[1];
+        size_t next_size_ = 0;
+        size_t previous_size_ = 0;
+    };
+};
+
+template <typename Iterator>
+void ReleaseAll(Iterator first, Iterator last) {
+    using Value = typename std::iterator_traits<Iterator>::value_type;
+    BatchReleaser::Release(first, last, static_cast<Value*>(nullptr));
+}
+
+template <typename Range>
+void ReleaseAll(Range& range) {
+    ReleaseAll(std::begin(range), std::end(range));
+}
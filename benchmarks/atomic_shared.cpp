@@ -0,0 +1,114 @@
+// Readers loading a published SharedPtr while one writer keeps replacing it:
+// AtomicSharedPtr against a SharedPtr guarded by a mutex, and SnapshotCell's cached reads.
+//
+// Build: cmake -S .. -B build && cmake --build build --target bench_atomic_shared
+// Usage: ./bench_atomic_shared [max_threads] [milliseconds]
+
+#include "../atomic_shared.h"
+#include "../snapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Config {
+    explicit Config(int version) : version(version) {
+    }
+
+    int version;
+};
+
+using ConfigPtr = SharedPtr<Config, MultiThreaded>;
+
+class MutexSlot {
+public:
+    explicit MutexSlot(ConfigPtr value) : value_(std::move(value)) {
+    }
+
+    ConfigPtr Load() const {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return value_;
+    }
+
+    void Store(ConfigPtr value) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        value_.Swap(value);
+    }
+
+private:
+    mutable std::mutex mutex_;
+    ConfigPtr value_;
+};
+
+// Readers borrow their thread's cached snapshot instead of taking a reference.
+class SnapshotSlot {
+public:
+    explicit SnapshotSlot(ConfigPtr value) : cell_(std::move(value)) {
+    }
+
+    const SnapshotCell<Config>::Snapshot& Load() const {
+        return cell_.Get();
+    }
+
+    void Store(ConfigPtr value) {
+        cell_.Publish(std::move(value));
+    }
+
+private:
+    SnapshotCell<Config> cell_;
+};
+
+template <typename Slot>
+double LoadsPerSecond(int readers, std::chrono::milliseconds duration) {
+    Slot slot(MakeShared<Config, MultiThreaded>(0));
+    std::atomic<bool> stop{false};
+    std::atomic<long long> total{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; ++i) {
+        threads.emplace_back([&] {
+            long long loads = 0;
+            long long checksum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                checksum += slot.Load()->version;
+                ++loads;
+            }
+            total += loads + (checksum < 0);
+        });
+    }
+    threads.emplace_back([&] {
+        for (int version = 1; !stop.load(std::memory_order_relaxed); ++version) {
+            slot.Store(MakeShared<Config, MultiThreaded>(version));
+            std::this_thread::yield();
+        }
+    });
+
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return total * 1000.0 / duration.count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    int max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    std::chrono::milliseconds duration(argc > 2 ? std::atoi(argv[2]) : 500);
+
+    std::printf("readers,atomic_loads_per_sec,mutex_loads_per_sec,snapshot_loads_per_sec\n");
+    for (int readers = 1; readers <= max_threads; readers *= 2) {
+        double atomic = LoadsPerSecond<AtomicSharedPtr<Config>>(readers, duration);
+        double mutex = LoadsPerSecond<MutexSlot>(readers, duration);
+        double snapshot = LoadsPerSecond<SnapshotSlot>(readers, duration);
+        std::printf("%d,%.0f,%.0f,%.0f\n", readers, atomic, mutex, snapshot);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Per-SharedPtr cost of creating, copying and destroying, single-threaded; batch_destroy
+// destroys the same number of pointers with ReleaseAll(). The scattered cases then destroy
+// pointers whose blocks were shuffled, so that consecutive releases miss the cache.
+//
+// Build: cmake -S .. -B build && cmake --build build --target bench_control_block
+// Usage: ./bench_control_block [iterations]
+
+#include "../batch_release.h"
+#include "../shared.h"
+#include "../weak.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+template <typename Function>
+double NanosecondsPerOp(size_t iterations, Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function(iterations);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+template <typename T, typename Policy, typename Factory>
+void Run(const char* name, size_t iterations, Factory factory) {
+    std::vector<SharedPtr<T, Policy>> pointers(iterations);
+    double create = NanosecondsPerOp(iterations, [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            pointers[i] = factory();
+        }
+    });
+    std::vector<SharedPtr<T, Policy>> copies(iterations);
+    double copy = NanosecondsPerOp(iterations, [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            copies[i] = pointers[i];
+        }
+    });
+    double release = NanosecondsPerOp(iterations, [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            copies[i].Reset();
+        }
+    });
+    double destroy = NanosecondsPerOp(iterations, [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            pointers[i].Reset();
+        }
+    });
+    for (size_t i = 0; i < iterations; ++i) {
+        pointers[i] = factory();
+    }
+    double batch_destroy = NanosecondsPerOp(iterations, [&](size_t) { ReleaseAll(pointers); });
+    std::printf("%s,%.2f,%.2f,%.2f,%.2f,%.2f\n", name, create, copy, release, destroy,
+                batch_destroy);
+}
+
+// Blocks are visited in random order: every release of the plain loop waits on a miss,
+// which ReleaseAll() overlaps with its prefetches.
+template <typename T, typename Policy, typename Factory>
+void RunScattered(const char* name, size_t iterations, Factory factory) {
+    std::vector<SharedPtr<T, Policy>> pointers(iterations);
+    std::mt19937 random(42);
+    auto fill = [&] {
+        for (size_t i = 0; i < iterations; ++i) {
+            pointers[i] = factory();
+        }
+        std::shuffle(pointers.begin(), pointers.end(), random);
+    };
+    fill();
+    double destroy = NanosecondsPerOp(iterations, [&](size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            pointers[i].Reset();
+        }
+    });
+    fill();
+    double batch_destroy = NanosecondsPerOp(iterations, [&](size_t) { ReleaseAll(pointers); });
+    std::printf("%s,%.2f,%.2f\n", name, destroy, batch_destroy);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t iterations = argc > 1 ? std::atoll(argv[1]) : 1000000;
+
+    std::printf("case,create_ns,copy_ns,release_ns,destroy_ns,batch_destroy_ns\n");
+    Run<int, SingleThreaded>("make_shared_int_st", iterations,
+                             [] { return MakeShared<int, SingleThreaded>(1); });
+    Run<int, MultiThreaded>("make_shared_int_mt", iterations,
+                            [] { return MakeShared<int, MultiThreaded>(1); });
+    Run<int, MultiThreaded>("new_int_mt", iterations,
+                            [] { return SharedPtr<int, MultiThreaded>(new int(1)); });
+    Run<std::string, MultiThreaded>("make_shared_string_mt", iterations, [] {
+        return MakeShared<std::string, MultiThreaded>("a string that does not fit in SSO");
+    });
+
+    std::printf("\ncase,destroy_ns,batch_destroy_ns\n");
+    RunScattered<int, SingleThreaded>("scattered_int_st", iterations,
+                                      [] { return MakeShared<int, SingleThreaded>(1); });
+    RunScattered<int, MultiThreaded>("scattered_int_mt", iterations,
+                                     [] { return MakeShared<int, MultiThreaded>(1); });
+    RunScattered<int, MultiThreaded>("scattered_new_int_mt", iterations,
+                                     [] { return SharedPtr<int, MultiThreaded>(new int(1)); });
+    return 0;
+}
@@ -0,0 +1,351 @@
+// Smart pointer microbenchmarks against their std:: equivalents, at 1..max_threads threads.
+//
+// Every thread runs the same loop; shared_* ops all work on a single object, so its
+// reference count is contended, private_* ones on an object of each thread's own.
+// The sw_sharded rows run the copy and lock cases with SharedPtr<T, Sharded>; its blocks
+// take a few kilobytes each, so it sits out the cases making one object per iteration.
+// Prints one CSV row per case, op, implementation and thread count, with the mean
+// over threads of the nanoseconds one op takes.
+//
+// Build: cmake -S .. -B build && cmake --build build --target bench_pointers
+// Usage: ./bench_pointers [max_threads] [iterations]
+
+#include "../intrusive.h"
+#include "../scalable.h"
+#include "../shared.h"
+#include "../unique.h"
+#include "../weak.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Ours {
+    static constexpr const char* kName = "sw";
+
+    template <typename T>
+    using Shared = SharedPtr<T>;
+
+    template <typename T>
+    using Weak = WeakPtr<T>;
+
+    template <typename T, typename Deleter>
+    using Unique = UniquePtr<T, Deleter>;
+
+    template <typename T, typename... Args>
+    static Shared<T> Make(Args&&... args) {
+        return MakeShared<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    static Shared<T> Lock(const Weak<T>& weak) {
+        return weak.Lock();
+    }
+};
+
+struct Scalable {
+    static constexpr const char* kName = "sw_sharded";
+
+    template <typename T>
+    using Shared = SharedPtr<T, Sharded>;
+
+    template <typename T>
+    using Weak = WeakPtr<T, Sharded>;
+
+    template <typename T, typename... Args>
+    static Shared<T> Make(Args&&... args) {
+        return MakeSharedScalable<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    static Shared<T> Lock(const Weak<T>& weak) {
+        return weak.Lock();
+    }
+};
+
+struct Std {
+    static constexpr const char* kName = "std";
+
+    template <typename T>
+    using Shared = std::shared_ptr<T>;
+
+    template <typename T>
+    using Weak = std::weak_ptr<T>;
+
+    template <typename T, typename Deleter>
+    using Unique = std::unique_ptr<T, Deleter>;
+
+    template <typename T, typename... Args>
+    static Shared<T> Make(Args&&... args) {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    static Shared<T> Lock(const Weak<T>& weak) {
+        return weak.lock();
+    }
+};
+
+struct EmptyDeleter {
+    void operator()(int* ptr) {
+        delete ptr;
+    }
+};
+
+struct StatefulDeleter {
+    void operator()(int* ptr) {
+        ++*deleted;
+        delete ptr;
+    }
+
+    size_t* deleted;
+};
+
+// An empty deleter must not cost a word.
+static_assert(sizeof(UniquePtr<int, EmptyDeleter>) == sizeof(int*));
+static_assert(sizeof(UniquePtr<int, StatefulDeleter>) == 2 * sizeof(int*));
+static_assert(sizeof(UniquePtr<int>) == sizeof(int*));
+
+struct Node : AtomicRefCounted<Node> {
+    int value = 0;
+};
+
+// Nanoseconds per op of the named phases one thread went through.
+using Timings = std::vector<std::pair<const char*, double>>;
+
+class Timer {
+public:
+    Timer() : start_(std::chrono::steady_clock::now()) {
+    }
+
+    double PerOp(size_t ops) const {
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start_;
+        return elapsed.count() / ops;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Runs `body` on `threads` threads released together and prints the mean of each phase.
+template <typename Body>
+void Run(const char* name, const char* impl, size_t threads, Body body) {
+    std::vector<Timings> results(threads);
+    std::atomic<size_t> waiting{threads};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            waiting.fetch_sub(1);
+            while (waiting.load() != 0) {
+                std::this_thread::yield();
+            }
+            results[i] = body();
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (size_t phase = 0; phase < results[0].size(); ++phase) {
+        double total = 0;
+        for (const Timings& timings : results) {
+            total += timings[phase].second;
+        }
+        std::printf("%s,%s,%s,%zu,%.2f\n", name, results[0][phase].first, impl, threads,
+                    total / threads);
+    }
+}
+
+template <typename Factory>
+Timings Lifecycle(size_t iterations, Factory factory) {
+    using Pointer = decltype(factory());
+    std::vector<Pointer> pointers(iterations);
+    std::vector<Pointer> copies(iterations);
+    std::vector<Pointer> moved(iterations);
+    Timings timings;
+
+    Timer create;
+    for (size_t i = 0; i < iterations; ++i) {
+        pointers[i] = factory();
+    }
+    timings.emplace_back("create", create.PerOp(iterations));
+
+    Timer copy;
+    for (size_t i = 0; i < iterations; ++i) {
+        copies[i] = pointers[i];
+    }
+    timings.emplace_back("copy", copy.PerOp(iterations));
+
+    Timer move;
+    for (size_t i = 0; i < iterations; ++i) {
+        moved[i] = std::move(copies[i]);
+    }
+    timings.emplace_back("move", move.PerOp(iterations));
+
+    // The copies go first, so that `destroy` measures the last release of each object.
+    for (size_t i = 0; i < iterations; ++i) {
+        moved[i] = nullptr;
+    }
+    Timer destroy;
+    for (size_t i = 0; i < iterations; ++i) {
+        pointers[i] = nullptr;
+    }
+    timings.emplace_back("destroy", destroy.PerOp(iterations));
+    return timings;
+}
+
+template <typename Pointer>
+double CopyRelease(const Pointer& source, size_t iterations) {
+    Timer timer;
+    for (size_t i = 0; i < iterations; ++i) {
+        Pointer copy = source;
+        // Keep the copy from being optimized away.
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    return timer.PerOp(iterations);
+}
+
+template <typename Impl>
+void RunCopy(size_t threads, size_t iterations) {
+    using Shared = typename Impl::template Shared<int>;
+    Shared shared = Impl::template Make<int>(1);
+    Run("shared_copy", Impl::kName, threads, [&] {
+        Shared own = Impl::template Make<int>(1);
+        Timings timings;
+        timings.emplace_back("private_copy_release", CopyRelease(own, iterations));
+        timings.emplace_back("shared_copy_release", CopyRelease(shared, iterations));
+        return timings;
+    });
+}
+
+template <typename Impl>
+void RunShared(size_t threads, size_t iterations) {
+    using Shared = typename Impl::template Shared<int>;
+    Run("make_shared", Impl::kName, threads, [&] {
+        return Lifecycle(iterations, [] { return Impl::template Make<int>(1); });
+    });
+    Run("shared_new", Impl::kName, threads, [&] {
+        return Lifecycle(iterations, [] { return Shared(new int(1)); });
+    });
+    RunCopy<Impl>(threads, iterations);
+}
+
+template <typename Impl>
+void RunWeak(size_t threads, size_t iterations) {
+    using Weak = typename Impl::template Weak<int>;
+    auto alive = Impl::template Make<int>(1);
+    Weak hit = alive;
+    Weak miss = Impl::template Make<int>(1);
+    Run("weak_lock", Impl::kName, threads, [&] {
+        Timings timings;
+        size_t locked = 0;
+        Timer lock_hit;
+        for (size_t i = 0; i < iterations; ++i) {
+            locked += static_cast<bool>(Impl::Lock(hit));
+        }
+        timings.emplace_back("shared_hit", lock_hit.PerOp(iterations));
+        Timer lock_miss;
+        for (size_t i = 0; i < iterations; ++i) {
+            locked += static_cast<bool>(Impl::Lock(miss));
+        }
+        timings.emplace_back("shared_miss", lock_miss.PerOp(iterations));
+        if (locked != iterations) {
+            std::abort();
+        }
+        return timings;
+    });
+}
+
+// IntrusivePtr has no std:: counterpart, so std::shared_ptr stands in for it.
+void RunIntrusive(size_t threads, size_t iterations) {
+    IntrusivePtr<Node> node = MakeIntrusive<Node>();
+    Run("intrusive_copy", Ours::kName, threads, [&] {
+        IntrusivePtr<Node> own = MakeIntrusive<Node>();
+        Timings timings;
+        timings.emplace_back("private_copy_release", CopyRelease(own, iterations));
+        timings.emplace_back("shared_copy_release", CopyRelease(node, iterations));
+        return timings;
+    });
+    auto shared = std::make_shared<Node>();
+    Run("intrusive_copy", Std::kName, threads, [&] {
+        auto own = std::make_shared<Node>();
+        Timings timings;
+        timings.emplace_back("private_copy_release", CopyRelease(own, iterations));
+        timings.emplace_back("shared_copy_release", CopyRelease(shared, iterations));
+        return timings;
+    });
+}
+
+template <typename Impl, typename Deleter>
+Timings UniqueLifecycle(size_t iterations, Deleter deleter) {
+    using Unique = typename Impl::template Unique<int, Deleter>;
+    std::vector<Unique> pointers;
+    std::vector<Unique> moved;
+    pointers.reserve(iterations);
+    moved.reserve(iterations);
+    Timings timings;
+
+    Timer create;
+    for (size_t i = 0; i < iterations; ++i) {
+        pointers.emplace_back(new int(1), deleter);
+    }
+    timings.emplace_back("create", create.PerOp(iterations));
+
+    Timer move;
+    for (size_t i = 0; i < iterations; ++i) {
+        moved.push_back(std::move(pointers[i]));
+    }
+    timings.emplace_back("move", move.PerOp(iterations));
+
+    Timer destroy;
+    moved.clear();
+    timings.emplace_back("destroy", destroy.PerOp(iterations));
+    return timings;
+}
+
+template <typename Impl>
+void RunUnique(size_t threads, size_t iterations) {
+    Run("unique_empty_deleter", Impl::kName, threads,
+        [&] { return UniqueLifecycle<Impl>(iterations, EmptyDeleter()); });
+    Run("unique_stateful_deleter", Impl::kName, threads, [&] {
+        size_t deleted = 0;
+        Timings timings = UniqueLifecycle<Impl>(iterations, StatefulDeleter{&deleted});
+        if (deleted != iterations) {
+            std::abort();
+        }
+        return timings;
+    });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (argc > 1) {
+        max_threads = std::atoll(argv[1]);
+    }
+    size_t iterations = argc > 2 ? std::atoll(argv[2]) : 200000;
+
+    std::printf("case,op,impl,threads,ns_per_op\n");
+    for (size_t threads = 1; threads <= max_threads; ++threads) {
+        RunShared<Ours>(threads, iterations);
+        RunShared<Std>(threads, iterations);
+        RunCopy<Scalable>(threads, iterations);
+        RunWeak<Ours>(threads, iterations);
+        RunWeak<Std>(threads, iterations);
+        RunWeak<Scalable>(threads, iterations);
+        RunIntrusive(threads, iterations);
+        RunUnique<Ours>(threads, iterations);
+        RunUnique<Std>(threads, iterations);
+    }
+    return 0;
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include "sw_fwd.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Biased reference counting policy: SharedPtr<T, Biased>, MakeShared<T, Biased>(...).
+//
+// The thread that creates a block owns it: its share of the strong count is updated with
+// plain loads and stores. Other threads use a separate atomic counter, which may go
+// negative when they drop references the owner made. The two are merged (and the block
+// stops being biased) once the owner drops its share to zero. A foreign thread that drives
+// the shared counter negative can't tell whether the owner's share is stale, so it hands
+// the block off to the owner, which merges the counts on its next Release() or on
+// BiasedOwner::CollectHandOffs(). After the owner thread exits, foreign threads merge
+// its blocks themselves.
+struct Biased {};
+
+template <>
+class RefCounts<Biased>;
+
+// Per-thread owner record. Records are recycled rather than freed, so a stale pointer
+// read from a block always refers to a live record.
+class BiasedOwner {
+    friend class RefCounts<Biased>;
+
+public:
+    // Settle references handed off to the calling thread. Owner threads that stop
+    // releasing pointers should call this periodically.
+    static void CollectHandOffs() {
+        BiasedOwner* owner = current_;
+        if (owner && owner->has_pending_.load(std::memory_order_relaxed)) {
+            owner->Drain();
+        }
+    }
+
+private:
+    struct Pool {
+        std::mutex mutex;
+        std::vector<BiasedOwner*> free;
+    };
+
+    struct Registration {
+        Registration() {
+            Pool& pool = GetPool();
+            std::lock_guard<std::mutex> guard(pool.mutex);
+            if (pool.free.empty()) {
+                current_ = new BiasedOwner;
+            } else {
+                current_ = pool.free.back();
+                pool.free.pop_back();
+            }
+            std::lock_guard<std::mutex> owner_guard(current_->mutex_);
+            current_->exited_ = false;
+            current_->blocks_.store(1, std::memory_order_relaxed);
+        }
+
+        ~Registration() {
+            BiasedOwner* owner = current_;
+            current_ = nullptr;
+            owner->Exit();
+        }
+    };
+
+    // Outlives all threads, so late thread exits can still return their records.
+    static Pool& GetPool() {
+        static Pool* pool = new Pool;
+        return *pool;
+    }
+
+    static BiasedOwner* Current() {
+        thread_local Registration registration;
+        return current_;
+    }
+
+    static BiasedOwner* Find() {
+        return current_;
+    }
+
+    void Attach() {
+        blocks_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Called when a block stops being biased to this record.
+    void Detach() {
+        if (blocks_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Pool& pool = GetPool();
+            std::lock_guard<std::mutex> guard(pool.mutex);
+            pool.free.push_back(this);
+        }
+    }
+
+    // Queue a pinned block for the owner to merge. Fails once the owner has exited.
+    bool Enqueue(ControlBlockBase<Biased>* block) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (exited_) {
+            return false;
+        }
+        pending_.push_back(block);
+        has_pending_.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    std::vector<ControlBlockBase<Biased>*> TakePending() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        has_pending_.store(false, std::memory_order_relaxed);
+        return std::move(pending_);
+    }
+
+    void Drain();
+
+    void Exit() {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            exited_ = true;
+        }
+        Drain();
+        Detach();
+    }
+
+    static inline thread_local BiasedOwner* current_ = nullptr;
+
+    std::mutex mutex_;
+    std::vector<ControlBlockBase<Biased>*> pending_;
+    bool exited_ = false;
+    std::atomic<bool> has_pending_{false};
+    // Blocks biased to this record, plus one while the thread is alive.
+    std::atomic<size_t> blocks_{1};
+};
+
+template <>
+class RefCounts<Biased> {
+public:
+    RefCounts() : owner_(BiasedOwner::Current()) {
+        owner_.load(std::memory_order_relaxed)->Attach();
+    }
+
+    void Increment() {
+        if (IsOwner()) {
+            biased_.store(biased_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        } else {
+            shared_.fetch_add(kSharedOne, std::memory_order_relaxed);
+        }
+    }
+
+    void IncrementWeak() {
+        weak_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Until the counts are merged the object can't die, so a foreign thread may still
+    // lock it after the last reference is dropped elsewhere but before the owner merges.
+    bool IncrementIfNotZero() {
+        if (IsOwner()) {
+            int64_t biased = biased_.load(std::memory_order_relaxed);
+            if (biased + Count(shared_.load(std::memory_order_acquire)) <= 0) {
+                return false;
+            }
+            biased_.store(biased + 1, std::memory_order_relaxed);
+            return true;
+        }
+        int64_t shared = shared_.load(std::memory_order_relaxed);
+        do {
+            if (IsMerged(shared) && Count(shared) == 0) {
+                return false;
+            }
+        } while (!shared_.compare_exchange_weak(shared, shared + kSharedOne,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+        return true;
+    }
+
+    // Returns true when the strong count dropped to zero.
+    bool Release(ControlBlockBase<Biased>* block) {
+        if (IsOwner()) {
+            int64_t biased = biased_.load(std::memory_order_relaxed) - 1;
+            biased_.store(biased, std::memory_order_relaxed);
+            return biased == 0 && Merge();
+        }
+        int64_t shared = shared_.load(std::memory_order_relaxed);
+        bool pinned = false;
+        do {
+            // Going negative means a hand-off, our reference keeps the block alive until
+            // we pin it with a weak one.
+            if (!pinned && !IsMerged(shared) && Count(shared) <= 0) {
+                IncrementWeak();
+                pinned = true;
+            }
+        } while (!shared_.compare_exchange_weak(shared, shared - kSharedOne,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+        if (!IsMerged(shared) && Count(shared) <= 0) {
+            HandOff(block);
+            return false;
+        }
+        if (pinned) {
+            // The strong references still hold their weak one, so this can't be the last.
+            ReleaseWeak();
+        }
+        return IsMerged(shared) && Count(shared) == 1;
+    }
+
+    // Returns true when the block is no longer referenced.
+    bool ReleaseWeak() {
+        return weak_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    size_t GetReferenceCount() const {
+        int64_t biased = biased_.load(std::memory_order_relaxed);
+        return biased + Count(shared_.load(std::memory_order_relaxed));
+    }
+
+    size_t GetWeakCount() const {
+        return weak_.load(std::memory_order_relaxed) - (GetReferenceCount() != 0);
+    }
+
+    // Merge the counts of a handed-off block and unpin it.
+    static void Settle(ControlBlockBase<Biased>* block);
+
+private:
+    // The shared word keeps the foreign count shifted left by one,
+    // the low bit is set once the owner's share has been merged in.
+    static constexpr int64_t kMerged = 1;
+    static constexpr int64_t kSharedOne = 2;
+
+    static int64_t Count(int64_t shared) {
+        return shared >> 1;
+    }
+
+    static bool IsMerged(int64_t shared) {
+        return shared & kMerged;
+    }
+
+    bool IsOwner() const {
+        BiasedOwner* owner = owner_.load(std::memory_order_relaxed);
+        return owner && owner == BiasedOwner::Find();
+    }
+
+    // Let the owner (or us, if it is gone) settle a pinned block.
+    void HandOff(ControlBlockBase<Biased>* block) {
+        BiasedOwner* owner = owner_.load(std::memory_order_acquire);
+        if (!owner || !owner->Enqueue(block)) {
+            Settle(block);
+        }
+    }
+
+    // Fold the owner's share into the shared counter. Only the owner thread merges
+    // while it is alive; afterwards the exchange elects a single foreign thread.
+    // Returns true when that leaves no strong references.
+    bool Merge() {
+        BiasedOwner* owner = owner_.exchange(nullptr, std::memory_order_acq_rel);
+        if (!owner) {
+            return false;
+        }
+        int64_t delta = biased_.load(std::memory_order_relaxed) * kSharedOne + kMerged;
+        biased_.store(0, std::memory_order_relaxed);
+        int64_t shared = shared_.fetch_add(delta, std::memory_order_acq_rel) + delta;
+        owner->Detach();
+        return Count(shared) == 0;
+    }
+
+    std::atomic<BiasedOwner*> owner_;
+    // Only written by the owner; atomic so that other threads may read it without a race.
+    std::atomic<int64_t> biased_{1};
+    std::atomic<int64_t> shared_{0};
+    std::atomic<size_t> weak_{1};
+};
+
+template <>
+inline void ControlBlockBase<Biased>::Release() {
+    if constexpr (kCountRefOps) {
+        ++ThreadRefCountOps().decrements;
+    }
+    if constexpr (kInstrumentTypes) {
+        Record(&TypeStats::OnDecrement);
+    }
+    if (counts_.Release(this)) {
+        DisposeObject();
+    }
+    BiasedOwner::CollectHandOffs();
+}
+
+inline void RefCounts<Biased>::Settle(ControlBlockBase<Biased>* block) {
+    if (block->counts_.Merge()) {
+        block->DisposeObject();
+    }
+    block->ReleaseWeak();
+}
+
+inline void BiasedOwner::Drain() {
+    for (ControlBlockBase<Biased>* block : TakePending()) {
+        RefCounts<Biased>::Settle(block);
+    }
+}
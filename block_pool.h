@@ -0,0 +1,144 @@
+#pragma once
+
+#include "free_list.h"
+
+#include <cstddef>
+#include <new>
+
+// Size-class pool for small, short-lived allocations such as control blocks.
+//
+// Sizes are rounded up to kGranularity; each class has a free list per thread and a
+// shared depot. A thread allocates from and frees to its own list without locking,
+// and trades kBatchSize blocks with the depot when its list runs dry or grows too long.
+// Memory is carved from kSlabSize slabs and is never returned to the system.
+// Requests larger than kMaxSize go straight to operator new.
+class BlockPool {
+public:
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kMaxSize = 512;
+    static constexpr size_t kBatchSize = 32;
+    static constexpr size_t kSlabSize = 64 * 1024;
+
+    static void* Allocate(size_t size) {
+        if (size > kMaxSize) {
+            return ::operator new(size);
+        }
+        size_t size_class = GetClass(size);
+        Cache* cache = Caches::Get();
+        if (!cache) {
+            return AllocateUncached(size_class);
+        }
+        FreeList& list = cache->lists[size_class];
+        if (void* ptr = GetDepot().Take(size_class, list)) {
+            return ptr;
+        }
+        Carve(size_class, list);
+        return list.Pop();
+    }
+
+    static void Deallocate(void* ptr, size_t size) {
+        if (size > kMaxSize) {
+            ::operator delete(ptr);
+            return;
+        }
+        size_t size_class = GetClass(size);
+        Cache* cache = Caches::Find();
+        if (!cache) {
+            GetDepot().Push(size_class, ptr);
+            return;
+        }
+        GetDepot().Give(size_class, cache->lists[size_class], ptr);
+    }
+
+private:
+    static constexpr size_t kClasses = kMaxSize / kGranularity;
+
+    using Depot = FreeListDepot<BlockPool, kClasses, kBatchSize>;
+
+    struct Cache {
+        FreeList lists[kClasses];
+    };
+
+    // Hands the thread's blocks back to the depot when the thread exits.
+    static void ReturnCache(Cache& cache) {
+        for (size_t size_class = 0; size_class < kClasses; ++size_class) {
+            GetDepot().Spill(size_class, cache.lists[size_class], cache.lists[size_class].size);
+        }
+    }
+
+    using Caches = ThreadCache<Cache, &ReturnCache>;
+
+    static size_t GetClass(size_t size) {
+        return size == 0 ? 0 : (size - 1) / kGranularity;
+    }
+
+    static Depot& GetDepot() {
+        return Depot::Get();
+    }
+
+    // For threads that are shutting down: the rest of a new slab goes to the depot.
+    static void* AllocateUncached(size_t size_class) {
+        if (void* ptr = GetDepot().Pop(size_class)) {
+            return ptr;
+        }
+        FreeList list;
+        Carve(size_class, list);
+        void* ptr = list.Pop();
+        GetDepot().Spill(size_class, list, list.size);
+        return ptr;
+    }
+
+    // Cut a new slab into blocks of the class: a batch goes to `list`, the rest to the depot.
+    static void Carve(size_t size_class, FreeList& list) {
+        size_t block_size = (size_class + 1) * kGranularity;
+        char* slab = static_cast<char*>(::operator new(kSlabSize));
+        FreeList blocks;
+        for (size_t offset = 0; offset + block_size <= kSlabSize; offset += block_size) {
+            blocks.Push(slab + offset);
+        }
+        for (size_t i = 0; i < kBatchSize; ++i) {
+            list.Push(blocks.Pop());
+        }
+        GetDepot().Spill(size_class, blocks, blocks.size);
+    }
+};
+
+// Stateless allocator drawing from BlockPool, e.g. for AllocateShared.
+// Over-aligned types bypass the pool.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {
+    }
+
+    T* allocate(size_t count) {
+        if constexpr (alignof(T) > BlockPool::kGranularity) {
+            return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+        } else {
+            return static_cast<T*>(BlockPool::Allocate(count * sizeof(T)));
+        }
+    }
+
+    void deallocate(T* ptr, size_t count) noexcept {
+        if constexpr (alignof(T) > BlockPool::kGranularity) {
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+        } else {
+            BlockPool::Deallocate(ptr, count * sizeof(T));
+        }
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept {
+        return false;
+    }
+};
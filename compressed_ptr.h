@@ -0,0 +1,367 @@
+#pragma once
+
+#include "shared.h"
+
+#include <cstddef>  // std::nullptr_t
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// Heap addressed by 32-bit handles: a handle counts kGranularity-byte granules, so it
+// reaches kMaxSize (32 GiB). The heap is split into kSegmentSize segments allocated on
+// demand; each is aligned to its size and starts with its own index, so both
+// Decode() and Encode() are a couple of arithmetic operations.
+//
+// Allocation rounds to granules and recycles freed memory through per-size free lists,
+// all under a single mutex.
+class CompressedHeap {
+public:
+    static constexpr size_t kGranularity = 8;
+    static constexpr size_t kMaxSize = (size_t{1} << 32) * kGranularity;
+    static constexpr int kSegmentShift = 24;
+    static constexpr size_t kSegmentSize = size_t{1} << kSegmentShift;
+
+    // Handle 0 is never returned: the first granule of a segment is its header.
+    static uint32_t Allocate(size_t size) {
+        size_t granules = (size + kGranularity - 1) / kGranularity;
+        if (granules == 0) {
+            granules = 1;
+        }
+        size_t size_class = GetClass(granules);
+        granules = GetGranules(size_class);
+        if (granules >= kGranulesPerSegment) {
+            throw std::bad_alloc();
+        }
+        std::lock_guard<std::mutex> guard(GetMutex());
+        uint32_t handle = free_[size_class];
+        if (handle != 0) {
+            free_[size_class] = *static_cast<uint32_t*>(Decode(handle));
+            return handle;
+        }
+        // Never fill a segment exactly: next_ would roll over into the unallocated next one.
+        if (!next_ || (next_ & kOffsetMask) + granules >= kGranulesPerSegment) {
+            AddSegment();
+        }
+        handle = next_;
+        next_ += granules;
+        return handle;
+    }
+
+    static void Deallocate(uint32_t handle, size_t size) {
+        size_t size_class = GetClass((size + kGranularity - 1) / kGranularity);
+        std::lock_guard<std::mutex> guard(GetMutex());
+        *static_cast<uint32_t*>(Decode(handle)) = free_[size_class];
+        free_[size_class] = handle;
+    }
+
+    static void* Decode(uint32_t handle) {
+        return segments_[handle >> kOffsetBits] + (handle & kOffsetMask) * kGranularity;
+    }
+
+    static uint32_t Encode(const void* ptr) {
+        uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        uintptr_t base = address & ~(kSegmentSize - 1);
+        uint32_t index = *reinterpret_cast<const uint32_t*>(base);
+        return (index << kOffsetBits) | static_cast<uint32_t>((address - base) / kGranularity);
+    }
+
+private:
+    static constexpr int kOffsetBits = kSegmentShift - 3;
+    static constexpr uint32_t kOffsetMask = (uint32_t{1} << kOffsetBits) - 1;
+    static constexpr size_t kGranulesPerSegment = kSegmentSize / kGranularity;
+    static constexpr size_t kSegments = kMaxSize / kSegmentSize;
+    // Exact classes for small sizes, powers of two above.
+    static constexpr size_t kExactClasses = 64;
+    static constexpr size_t kClasses = kExactClasses + 32;
+
+    static_assert(kGranularity == 8, "kOffsetBits assumes 8-byte granules");
+
+    static size_t GetClass(size_t granules) {
+        if (granules <= kExactClasses) {
+            return granules - 1;
+        }
+        size_t size_class = kExactClasses;
+        for (size_t capacity = kExactClasses * 2; capacity < granules; capacity *= 2) {
+            ++size_class;
+        }
+        return size_class;
+    }
+
+    static size_t GetGranules(size_t size_class) {
+        if (size_class < kExactClasses) {
+            return size_class + 1;
+        }
+        return kExactClasses << (size_class - kExactClasses + 1);
+    }
+
+    // Called with the mutex held. The tail of the previous segment is abandoned.
+    static void AddSegment() {
+        if (segment_count_ == kSegments) {
+            throw std::bad_alloc();
+        }
+        auto segment = static_cast<unsigned char*>(
+            ::operator new(kSegmentSize, std::align_val_t(kSegmentSize)));
+        *reinterpret_cast<uint32_t*>(segment) = static_cast<uint32_t>(segment_count_);
+        segments_[segment_count_] = segment;
+        next_ = static_cast<uint32_t>(segment_count_ << kOffsetBits) + 1;
+        ++segment_count_;
+    }
+
+    static std::mutex& GetMutex() {
+        static std::mutex* mutex = new std::mutex;
+        return *mutex;
+    }
+
+    // Written under the mutex before any handle into the segment is handed out.
+    static inline unsigned char* segments_[kSegments] = {};
+    static inline size_t segment_count_ = 0;
+    static inline uint32_t next_ = 0;
+    static inline uint32_t free_[kClasses] = {};
+};
+
+// Stateless allocator drawing from CompressedHeap, e.g. for the blocks of CompressedSharedPtr.
+template <typename T>
+class CompressedAllocator {
+    static_assert(alignof(T) <= CompressedHeap::kGranularity, "over-aligned types don't fit");
+
+public:
+    using value_type = T;
+
+    CompressedAllocator() = default;
+
+    template <typename U>
+    CompressedAllocator(const CompressedAllocator<U>&) noexcept {
+    }
+
+    T* allocate(size_t count) {
+        uint32_t handle = CompressedHeap::Allocate(count * sizeof(T));
+        return static_cast<T*>(CompressedHeap::Decode(handle));
+    }
+
+    void deallocate(T* ptr, size_t count) noexcept {
+        CompressedHeap::Deallocate(CompressedHeap::Encode(ptr), count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const CompressedAllocator<U>&) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const CompressedAllocator<U>&) const noexcept {
+        return false;
+    }
+};
+
+// UniquePtr in four bytes, for objects made by MakeCompressedUnique.
+template <typename T>
+class CompressedUniquePtr {
+    static_assert(alignof(T) <= CompressedHeap::kGranularity, "over-aligned types don't fit");
+
+    template <typename Y, typename... Args>
+    friend CompressedUniquePtr<Y> MakeCompressedUnique(Args&&... args);
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    constexpr CompressedUniquePtr() noexcept : handle_(0) {
+    }
+
+    constexpr CompressedUniquePtr(std::nullptr_t) noexcept : CompressedUniquePtr() {
+    }
+
+    CompressedUniquePtr(CompressedUniquePtr&& other) noexcept
+            : handle_(std::exchange(other.handle_, 0)) {
+    }
+
+    CompressedUniquePtr(const CompressedUniquePtr&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+    CompressedUniquePtr& operator=(CompressedUniquePtr&& other) noexcept {
+        CompressedUniquePtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    CompressedUniquePtr& operator=(std::nullptr_t) noexcept {
+        Reset();
+        return *this;
+    }
+
+    CompressedUniquePtr& operator=(const CompressedUniquePtr&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~CompressedUniquePtr() {
+        if (handle_) {
+            Get()->~T();
+            CompressedHeap::Deallocate(handle_, sizeof(T));
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Reset() noexcept {
+        CompressedUniquePtr().Swap(*this);
+    }
+
+    void Swap(CompressedUniquePtr& other) noexcept {
+        std::swap(handle_, other.handle_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    T* Get() const noexcept {
+        return handle_ ? static_cast<T*>(CompressedHeap::Decode(handle_)) : nullptr;
+    }
+
+    T& operator*() const noexcept {
+        return *Get();
+    }
+
+    T* operator->() const noexcept {
+        return Get();
+    }
+
+    explicit operator bool() const noexcept {
+        return handle_ != 0;
+    }
+
+private:
+    uint32_t handle_;
+};
+
+template <typename T, typename... Args>
+CompressedUniquePtr<T> MakeCompressedUnique(Args&&... args) {
+    uint32_t handle = CompressedHeap::Allocate(sizeof(T));
+    try {
+        ::new (CompressedHeap::Decode(handle)) T(std::forward<Args>(args)...);
+    } catch (...) {
+        CompressedHeap::Deallocate(handle, sizeof(T));
+        throw;
+    }
+    CompressedUniquePtr<T> unique_ptr;
+    unique_ptr.handle_ = handle;
+    return unique_ptr;
+}
+
+// SharedPtr in four bytes: the handle of a MakeShared-style block living in CompressedHeap.
+// Converts to an ordinary SharedPtr implicitly.
+template <typename T, typename Policy>
+class CompressedSharedPtr {
+    using Holder = ControlBlockHolder<T, Policy, CompressedAllocator<T>>;
+
+    template <typename Y, typename P, typename... Args>
+    friend CompressedSharedPtr<Y, P> MakeCompressedShared(Args&&... args);
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    constexpr CompressedSharedPtr() noexcept : handle_(0) {
+    }
+
+    constexpr CompressedSharedPtr(std::nullptr_t) noexcept : CompressedSharedPtr() {
+    }
+
+    CompressedSharedPtr(const CompressedSharedPtr& other) noexcept : handle_(other.handle_) {
+        AddRef();
+    }
+
+    CompressedSharedPtr(CompressedSharedPtr&& other) noexcept
+            : handle_(std::exchange(other.handle_, 0)) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+    CompressedSharedPtr& operator=(const CompressedSharedPtr& other) noexcept {
+        CompressedSharedPtr(other).Swap(*this);
+        return *this;
+    }
+
+    CompressedSharedPtr& operator=(CompressedSharedPtr&& other) noexcept {
+        CompressedSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~CompressedSharedPtr() {
+        if (handle_) {
+            GetHolder()->Release();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Conversions
+    operator SharedPtr<T, Policy>() const& noexcept {
+        AddRef();
+        return SharedPtr<T, Policy>(AdoptBlock(), Get(), GetHolder());
+    }
+
+    operator SharedPtr<T, Policy>() && noexcept {
+        Holder* holder = GetHolder();
+        handle_ = 0;
+        return SharedPtr<T, Policy>(AdoptBlock(), holder ? holder->GetPointer() : nullptr, holder);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Reset() noexcept {
+        CompressedSharedPtr().Swap(*this);
+    }
+
+    void Swap(CompressedSharedPtr& other) noexcept {
+        std::swap(handle_, other.handle_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    T* Get() const noexcept {
+        return handle_ ? GetHolder()->GetPointer() : nullptr;
+    }
+
+    T& operator*() const noexcept {
+        return *Get();
+    }
+
+    T* operator->() const noexcept {
+        return Get();
+    }
+
+    size_t UseCount() const noexcept {
+        if (!handle_) {
+            return 0;
+        }
+        return GetHolder()->GetReferenceCount();
+    }
+
+    explicit operator bool() const noexcept {
+        return handle_ != 0;
+    }
+
+private:
+    Holder* GetHolder() const {
+        return handle_ ? static_cast<Holder*>(CompressedHeap::Decode(handle_)) : nullptr;
+    }
+
+    void AddRef() const {
+        if (handle_) {
+            GetHolder()->Increment();
+        }
+    }
+
+    uint32_t handle_;
+};
+
+template <typename T, typename Policy, typename... Args>
+CompressedSharedPtr<T, Policy> MakeCompressedShared(Args&&... args) {
+    auto block = NewBlock<ControlBlockHolder<T, Policy, CompressedAllocator<T>>>(
+        CompressedAllocator<T>(), std::forward<Args>(args)...);
+    // Goes through SharedPtr to hook up EnableSharedFromThis.
+    SharedPtr<T, Policy> shared(AdoptBlock(), block->GetPointer(), block);
+    CompressedSharedPtr<T, Policy> compressed;
+    compressed.handle_ = CompressedHeap::Encode(std::exchange(shared.block_, nullptr));
+    shared.observed_ = nullptr;
+    return compressed;
+}
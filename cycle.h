@@ -0,0 +1,368 @@
+#pragma once
+
+#include "intrusive.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+class CycleTracer;
+class CycleCollector;
+
+// Reference count of a CycleCollected object, plus the state the collector keeps on it.
+// Objects reachable from each other must stay on one thread, like with SimpleRefCounted.
+class CycleNode {
+    friend class CycleCollector;
+
+public:
+    void IncRef() {
+        ++count_;
+        if (color_ == Color::kPurple) {
+            color_ = Color::kBlack;
+        }
+    }
+
+    // Destroys the object when the last reference dies, and buffers it as a possible
+    // root of a garbage cycle when some references remain.
+    void DecRef();
+
+    size_t RefCount() const {
+        return count_;
+    }
+
+protected:
+    enum class NodeOp {
+        kTrace,
+        kDestroy,
+    };
+
+    using Manager = void (*)(CycleNode* node, NodeOp op, CycleTracer* tracer);
+
+    explicit CycleNode(Manager manager) : manager_(manager) {
+    }
+
+    // Copying an object doesn't copy its references, so copies start at zero.
+    CycleNode(const CycleNode& other) : manager_(other.manager_) {
+    }
+
+    CycleNode& operator=(const CycleNode&) {
+        return *this;
+    }
+
+    ~CycleNode() = default;
+
+private:
+    enum class Color : uint8_t {
+        kBlack,    // In use.
+        kGray,     // Possibly a member of a garbage cycle.
+        kWhite,    // Member of a garbage cycle.
+        kPurple,   // Possible root of a garbage cycle, buffered.
+        kFreeing,  // Garbage being torn down by the collector.
+    };
+
+    static constexpr size_t kNotBuffered = SIZE_MAX;
+
+    size_t count_ = 0;
+    size_t root_index_ = kNotBuffered;
+    Manager manager_;
+    Color color_ = Color::kBlack;
+};
+
+// Handed to Trace(): call it once for every IntrusivePtr the object holds.
+// The collector may reset the pointers it is given while tearing down a cycle.
+class CycleTracer {
+    friend class CycleCollector;
+
+public:
+    template <typename T>
+    void operator()(IntrusivePtr<T>& ptr) {
+        static_assert(std::is_base_of_v<CycleNode, T>, "only CycleCollected types can be traced");
+        if (!ptr) {
+            return;
+        }
+        if (edges_) {
+            edges_->push_back(ptr.Get());
+        } else {
+            ptr.Reset();
+        }
+    }
+
+private:
+    explicit CycleTracer(std::vector<CycleNode*>* edges) : edges_(edges) {
+    }
+
+    std::vector<CycleNode*>* edges_;  // Null when breaking the edges.
+};
+
+// Synchronous trial deletion (Bacon & Rajan, "Concurrent Cycle Collection in Reference
+// Counted Systems"): decrement the counts along every edge reachable from the buffered
+// roots; whatever drops to zero is referenced only from inside, i.e. garbage.
+//
+// Nothing runs behind the thread's back: call Collect() at convenient points, e.g. once a
+// frame with a time budget. Roots are processed in passes of kPassRoots; a pass is never
+// interrupted, so a pass over a huge subgraph may overrun the budget.
+class CycleCollector {
+    friend class CycleNode;
+
+public:
+    static constexpr size_t kPassRoots = 64;
+
+    // Free the garbage cycles found from the roots buffered on this thread, until they run
+    // out or `budget` is spent; the rest stay buffered. Returns the number of objects freed.
+    static size_t Collect(std::chrono::nanoseconds budget = std::chrono::nanoseconds::max()) {
+        State* state = state_ ? state_ : CreateState();
+        if (!state || state->collecting) {
+            return 0;
+        }
+        state->collecting = true;
+        size_t freed = 0;
+        auto start = std::chrono::steady_clock::now();
+        do {
+            freed += CollectPass(*state);
+        } while (!state->roots.empty() && std::chrono::steady_clock::now() - start < budget);
+        state->collecting = false;
+        return freed;
+    }
+
+    // Possible cycle roots buffered on this thread.
+    static size_t PendingRoots() {
+        return state_ ? state_->roots.size() : 0;
+    }
+
+private:
+    using Color = CycleNode::Color;
+
+    struct State {
+        std::vector<CycleNode*> roots;
+        // Scratch space, kept to avoid allocating on every pass.
+        std::vector<CycleNode*> batch;
+        std::vector<CycleNode*> stack;
+        std::vector<CycleNode*> black_stack;
+        std::vector<CycleNode*> edges;
+        std::vector<CycleNode*> garbage;
+        bool collecting = false;
+    };
+
+    // Frees the thread's last cycles when it exits.
+    struct Registration {
+        Registration() {
+            state_ = &state;
+        }
+
+        ~Registration() {
+            Collect();
+            for (CycleNode* node : state.roots) {
+                node->root_index_ = CycleNode::kNotBuffered;
+                node->color_ = Color::kBlack;
+            }
+            state_ = nullptr;
+        }
+
+        State state;
+    };
+
+    // Returns null while the thread is shutting down.
+    static State* CreateState() {
+        static thread_local bool created = false;
+        if (created) {
+            return nullptr;
+        }
+        created = true;
+        thread_local Registration registration;
+        return state_;
+    }
+
+    static void AddRoot(CycleNode* node) {
+        State* state = state_ ? state_ : CreateState();
+        if (!state) {
+            return;
+        }
+        node->color_ = Color::kPurple;
+        // Still buffered if it was referenced again after becoming a root.
+        if (node->root_index_ == CycleNode::kNotBuffered) {
+            node->root_index_ = state->roots.size();
+            state->roots.push_back(node);
+        }
+    }
+
+    static void Free(CycleNode* node) {
+        if (node->root_index_ != CycleNode::kNotBuffered) {
+            Unbuffer(node);
+        }
+        node->manager_(node, CycleNode::NodeOp::kDestroy, nullptr);
+    }
+
+    static void Unbuffer(CycleNode* node) {
+        std::vector<CycleNode*>& roots = state_->roots;
+        CycleNode* last = roots.back();
+        roots[node->root_index_] = last;
+        last->root_index_ = node->root_index_;
+        roots.pop_back();
+        node->root_index_ = CycleNode::kNotBuffered;
+    }
+
+    static void GetEdges(CycleNode* node, std::vector<CycleNode*>& edges) {
+        edges.clear();
+        CycleTracer tracer(&edges);
+        node->manager_(node, CycleNode::NodeOp::kTrace, &tracer);
+    }
+
+    static size_t CollectPass(State& state) {
+        state.batch.clear();
+        while (!state.roots.empty() && state.batch.size() < kPassRoots) {
+            CycleNode* node = state.roots.back();
+            state.roots.pop_back();
+            node->root_index_ = CycleNode::kNotBuffered;
+            // Roots referenced again since are black, they don't need a look.
+            if (node->color_ == Color::kPurple) {
+                state.batch.push_back(node);
+            }
+        }
+        for (CycleNode* node : state.batch) {
+            MarkGray(state, node);
+        }
+        for (CycleNode* node : state.batch) {
+            Scan(state, node);
+        }
+        state.garbage.clear();
+        for (CycleNode* node : state.batch) {
+            CollectWhite(state, node);
+        }
+        return FreeGarbage(state);
+    }
+
+    // Remove the references coming from the subgraph below `root`.
+    static void MarkGray(State& state, CycleNode* root) {
+        if (root->color_ == Color::kGray) {
+            return;
+        }
+        root->color_ = Color::kGray;
+        state.stack.push_back(root);
+        while (!state.stack.empty()) {
+            CycleNode* node = state.stack.back();
+            state.stack.pop_back();
+            GetEdges(node, state.edges);
+            for (CycleNode* child : state.edges) {
+                --child->count_;
+                if (child->color_ != Color::kGray) {
+                    child->color_ = Color::kGray;
+                    state.stack.push_back(child);
+                }
+            }
+        }
+    }
+
+    // Whiten the gray nodes left without references, and restore everything that is
+    // still referenced from outside.
+    static void Scan(State& state, CycleNode* root) {
+        state.stack.push_back(root);
+        while (!state.stack.empty()) {
+            CycleNode* node = state.stack.back();
+            state.stack.pop_back();
+            if (node->color_ != Color::kGray) {
+                continue;
+            }
+            if (node->count_ > 0) {
+                ScanBlack(state, node);
+                continue;
+            }
+            node->color_ = Color::kWhite;
+            GetEdges(node, state.edges);
+            state.stack.insert(state.stack.end(), state.edges.begin(), state.edges.end());
+        }
+    }
+
+    static void ScanBlack(State& state, CycleNode* root) {
+        root->color_ = Color::kBlack;
+        state.black_stack.push_back(root);
+        while (!state.black_stack.empty()) {
+            CycleNode* node = state.black_stack.back();
+            state.black_stack.pop_back();
+            GetEdges(node, state.edges);
+            for (CycleNode* child : state.edges) {
+                ++child->count_;
+                if (child->color_ != Color::kBlack) {
+                    child->color_ = Color::kBlack;
+                    state.black_stack.push_back(child);
+                }
+            }
+        }
+    }
+
+    static void CollectWhite(State& state, CycleNode* root) {
+        state.stack.push_back(root);
+        while (!state.stack.empty()) {
+            CycleNode* node = state.stack.back();
+            state.stack.pop_back();
+            if (node->color_ != Color::kWhite) {
+                continue;
+            }
+            node->color_ = Color::kFreeing;
+            // It may still sit in the buffer if a later root pointed to it.
+            if (node->root_index_ != CycleNode::kNotBuffered) {
+                Unbuffer(node);
+            }
+            state.garbage.push_back(node);
+            GetEdges(node, state.edges);
+            state.stack.insert(state.stack.end(), state.edges.begin(), state.edges.end());
+        }
+    }
+
+    // Destructors of the garbage would release references into objects already gone, so
+    // the edges are broken first: restore the real counts, pin every member, reset its
+    // pointers through the tracer, then drop the pins.
+    static size_t FreeGarbage(State& state) {
+        for (CycleNode* node : state.garbage) {
+            GetEdges(node, state.edges);
+            for (CycleNode* child : state.edges) {
+                ++child->count_;
+            }
+            ++node->count_;
+        }
+        for (CycleNode* node : state.garbage) {
+            CycleTracer tracer(nullptr);
+            node->manager_(node, CycleNode::NodeOp::kTrace, &tracer);
+        }
+        for (CycleNode* node : state.garbage) {
+            node->color_ = Color::kBlack;
+            node->DecRef();
+        }
+        return state.garbage.size();
+    }
+
+    static inline thread_local State* state_ = nullptr;
+};
+
+inline void CycleNode::DecRef() {
+    if (--count_ == 0) {
+        CycleCollector::Free(this);
+    } else if (color_ == Color::kBlack) {
+        CycleCollector::AddRoot(this);
+    }
+}
+
+// Base for reference counted objects that may form cycles through IntrusivePtr members.
+// Derived has to provide a public `void Trace(CycleTracer& tracer)` calling `tracer(ptr)`
+// for each IntrusivePtr member; an edge left out hides the cycles through it.
+template <typename Derived, typename Deleter = DefaultDelete>
+class CycleCollected : public CycleNode {
+public:
+    CycleCollected() : CycleNode(&Manage) {
+    }
+
+    CycleCollected(const CycleCollected& other) = default;
+
+    CycleCollected& operator=(const CycleCollected& other) = default;
+
+private:
+    static void Manage(CycleNode* node, NodeOp op, CycleTracer* tracer) {
+        auto object = static_cast<Derived*>(static_cast<CycleCollected*>(node));
+        if (op == NodeOp::kTrace) {
+            object->Trace(*tracer);
+        } else {
+            Deleter::Destroy(object);
+        }
+    }
+};
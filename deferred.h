@@ -0,0 +1,204 @@
+#pragma once
+
+#include "shared.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Takes destructor cost off the hot path: objects dying through the queue (DeferredDelete,
+// DeferredDeleter, MakeDeferredShared) are queued instead of destroyed, and destroyed in
+// batches by Collect() or by the background reclaimer.
+//
+// Destructors run on whichever thread drains the queue, so they must not depend on the
+// thread that dropped the last reference. Objects queued during a drain, e.g. members
+// held through deferred pointers, wait for the next one.
+class DestructionQueue {
+public:
+    using Reclaim = void (*)(void* object);
+
+    struct Stats {
+        size_t depth = 0;       // Objects waiting to be destroyed.
+        size_t peak_depth = 0;  // Largest depth seen so far.
+        size_t queued = 0;      // Objects queued since the start.
+        size_t destroyed = 0;   // Objects destroyed since the start.
+    };
+
+    // Queue depth at which the reclaimer is woken up before its period is over.
+    static constexpr size_t kWakeDepth = 256;
+
+    static void Retire(void* object, Reclaim reclaim) {
+        State& state = GetState();
+        size_t depth;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> guard(state.mutex);
+            state.queue.push_back({object, reclaim});
+            depth = state.queue.size();
+            wake = state.running && depth == kWakeDepth;
+        }
+        queued_.fetch_add(1, std::memory_order_relaxed);
+        size_t peak = peak_depth_.load(std::memory_order_relaxed);
+        while (peak < depth && !peak_depth_.compare_exchange_weak(peak, depth,
+                                                                  std::memory_order_relaxed)) {
+        }
+        if (wake) {
+            state.wake.notify_one();
+        }
+    }
+
+    template <typename T>
+    static void Retire(T* object) {
+        Retire(const_cast<std::remove_cv_t<T>*>(object),
+               [](void* ptr) { delete static_cast<T*>(ptr); });
+    }
+
+    // Destroy everything queued so far. Returns the number of objects destroyed.
+    static size_t Collect() {
+        State& state = GetState();
+        std::vector<Entry> batch;
+        {
+            std::lock_guard<std::mutex> guard(state.mutex);
+            batch.swap(state.queue);
+        }
+        for (const Entry& entry : batch) {
+            entry.reclaim(entry.object);
+        }
+        destroyed_.fetch_add(batch.size(), std::memory_order_relaxed);
+        return batch.size();
+    }
+
+    // Start a thread collecting every `period`, or as soon as kWakeDepth objects are queued.
+    static void StartReclaimer(std::chrono::milliseconds period = std::chrono::milliseconds(10)) {
+        State& state = GetState();
+        std::lock_guard<std::mutex> guard(state.mutex);
+        if (state.running) {
+            return;
+        }
+        state.running = true;
+        state.stop = false;
+        state.reclaimer = std::thread(&DestructionQueue::RunReclaimer, period);
+    }
+
+    // Stop the reclaimer thread after a final collection.
+    static void StopReclaimer() {
+        State& state = GetState();
+        std::thread reclaimer;
+        {
+            std::lock_guard<std::mutex> guard(state.mutex);
+            if (!state.running) {
+                return;
+            }
+            state.stop = true;
+            reclaimer = std::move(state.reclaimer);
+        }
+        state.wake.notify_one();
+        reclaimer.join();
+        std::lock_guard<std::mutex> guard(state.mutex);
+        state.running = false;
+    }
+
+    static size_t Depth() {
+        std::lock_guard<std::mutex> guard(GetState().mutex);
+        return GetState().queue.size();
+    }
+
+    static Stats GetStats() {
+        Stats stats;
+        stats.depth = Depth();
+        stats.peak_depth = peak_depth_.load(std::memory_order_relaxed);
+        stats.queued = queued_.load(std::memory_order_relaxed);
+        stats.destroyed = destroyed_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Entry {
+        void* object;
+        Reclaim reclaim;
+    };
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<Entry> queue;
+        std::thread reclaimer;
+        bool running = false;
+        bool stop = false;
+    };
+
+    static void RunReclaimer(std::chrono::milliseconds period) {
+        State& state = GetState();
+        while (true) {
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.wake.wait_for(lock, period, [&state] {
+                    return state.stop || state.queue.size() >= kWakeDepth;
+                });
+                stop = state.stop;
+            }
+            Collect();
+            if (stop) {
+                return;
+            }
+        }
+    }
+
+    // Outlives all threads, so objects may be queued during shutdown.
+    static State& GetState() {
+        static State* state = new State;
+        return *state;
+    }
+
+    static inline std::atomic<size_t> peak_depth_{0};
+    static inline std::atomic<size_t> queued_{0};
+    static inline std::atomic<size_t> destroyed_{0};
+};
+
+// Deleter for RefCounted, e.g. AtomicRefCounted<Session, DeferredDelete>.
+struct DeferredDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        DestructionQueue::Retire(object);
+    }
+};
+
+// Deleter for UniquePtr, e.g. UniquePtr<Session, DeferredDeleter<Session>>.
+template <typename T>
+struct DeferredDeleter {
+    DeferredDeleter() = default;
+
+    template <typename U>
+    DeferredDeleter(const DeferredDeleter<U>&) {
+    }
+
+    void operator()(T* ptr) {
+        DestructionQueue::Retire(ptr);
+    }
+};
+
+template <typename T>
+struct DeferredDeleter<T[]> {
+    DeferredDeleter() = default;
+
+    template <typename U>
+    DeferredDeleter(const DeferredDeleter<U>&) {
+    }
+
+    void operator()(T* ptr) {
+        DestructionQueue::Retire(const_cast<std::remove_cv_t<T>*>(ptr),
+                                 [](void* array) { delete[] static_cast<T*>(array); });
+    }
+};
+
+// Like MakeShared, but the object dying with its last SharedPtr is queued for destruction.
+template <typename T, typename Policy = DefaultPolicy, typename... Args>
+SharedPtr<T, Policy> MakeDeferredShared(Args&&... args) {
+    auto block = NewBlock<ControlBlockDeferred<T, Policy, DestructionQueue>>(
+        DefaultBlockAllocator<T>(), std::forward<Args>(args)...);
+    return SharedPtr<T, Policy>(AdoptBlock(), block->GetPointer(), block);
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "shared.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation: readers inside an EpochGuard may use raw pointers taken from
+// an IntrusivePtr or SharedPtr without touching the reference counts, as long as the
+// object is destroyed through the domain (EpochDelete, MakeEpochShared).
+//
+// Such objects aren't destroyed when their last reference dies but retired, stamped with
+// the global epoch. The epoch only advances once every thread inside a guard has observed
+// the current one, so two advances later no reader can still see the retired object.
+// Readers pay a store and a fence on entering the outermost guard; retired objects are
+// reclaimed in batches by the retiring thread, or by Collect().
+//
+// The intended use is copy-on-write data: writers publish new versions through an
+// atomic pointer (or AtomicSharedPtr) and drop the old ones, readers traverse whatever
+// version they picked up under a guard.
+class EpochDomain {
+public:
+    using Reclaim = void (*)(void* object);
+
+    // Retired objects a thread accumulates before it tries to reclaim some.
+    static constexpr size_t kCollectThreshold = 64;
+
+    static void Enter() {
+        Record* record = GetRecord();
+        if (record && record->nesting++ == 0) {
+            record->epoch.store(global_epoch_.load(std::memory_order_relaxed),
+                                std::memory_order_relaxed);
+            // Our announcement has to be visible before we read any shared pointer.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    static void Leave() {
+        Record* record = current_;
+        if (record && --record->nesting == 0) {
+            record->epoch.store(kInactive, std::memory_order_release);
+        }
+    }
+
+    // Destroy `object` with `reclaim` once no reader can reach it anymore.
+    // The object has to be unreachable for readers entering from now on.
+    static void Retire(void* object, Reclaim reclaim) {
+        Retired retired{object, reclaim, global_epoch_.load(std::memory_order_seq_cst)};
+        Record* record = GetRecord();
+        if (!record) {
+            GetOrphans().Add({retired});
+            return;
+        }
+        record->retired.push_back(retired);
+        if (record->retired.size() >= kCollectThreshold) {
+            Collect();
+        }
+    }
+
+    template <typename T>
+    static void Retire(T* object) {
+        Retire(object, [](void* ptr) { delete static_cast<T*>(ptr); });
+    }
+
+    // Try to advance the epoch and reclaim whatever became safe, both from the calling
+    // thread's objects and from those left behind by exited threads.
+    static void Collect() {
+        uint64_t epoch = TryAdvance();
+        std::vector<Retired> ready;
+        if (Record* record = current_) {
+            TakeReady(record->retired, epoch, ready);
+        }
+        GetOrphans().TakeReady(epoch, ready);
+        // Reclaiming may retire more objects, so the lists are left alone by now.
+        for (const Retired& retired : ready) {
+            retired.reclaim(retired.object);
+        }
+    }
+
+private:
+    static constexpr uint64_t kInactive = ~uint64_t{0};
+
+    struct Retired {
+        void* object;
+        Reclaim reclaim;
+        uint64_t epoch;
+    };
+
+    // Per-thread state. Records are linked into a list that never shrinks and are
+    // recycled by later threads, so walking the list needs no synchronisation.
+    struct Record {
+        std::atomic<uint64_t> epoch{kInactive};
+        std::atomic<bool> in_use{true};
+        Record* next = nullptr;
+        size_t nesting = 0;
+        std::vector<Retired> retired;
+    };
+
+    struct Orphans {
+        void Add(std::vector<Retired> retired) {
+            std::lock_guard<std::mutex> guard(mutex);
+            list.insert(list.end(), retired.begin(), retired.end());
+        }
+
+        void TakeReady(uint64_t epoch, std::vector<Retired>& ready) {
+            std::lock_guard<std::mutex> guard(mutex);
+            EpochDomain::TakeReady(list, epoch, ready);
+        }
+
+        std::mutex mutex;
+        std::vector<Retired> list;
+    };
+
+    struct Registration {
+        Registration() {
+            current_ = Acquire();
+        }
+
+        // Objects still waiting are handed over to whoever collects next.
+        ~Registration() {
+            Record* record = current_;
+            current_ = nullptr;
+            GetOrphans().Add(std::move(record->retired));
+            record->retired.clear();
+            record->nesting = 0;
+            record->epoch.store(kInactive, std::memory_order_release);
+            record->in_use.store(false, std::memory_order_release);
+        }
+    };
+
+    static Record* Acquire() {
+        for (Record* record = records_.load(std::memory_order_acquire); record;
+             record = record->next) {
+            bool in_use = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(in_use, true,
+                                                       std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        Record* record = new Record;
+        record->next = records_.load(std::memory_order_relaxed);
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+        return record;
+    }
+
+    // Returns null while the thread is shutting down.
+    static Record* GetRecord() {
+        if (current_) {
+            return current_;
+        }
+        static thread_local bool created = false;
+        if (created) {
+            return nullptr;
+        }
+        created = true;
+        thread_local Registration registration;
+        return current_;
+    }
+
+    // Advance the epoch if every reader has caught up with it. Returns the current epoch.
+    static uint64_t TryAdvance() {
+        uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (Record* record = records_.load(std::memory_order_acquire); record;
+             record = record->next) {
+            uint64_t announced = record->epoch.load(std::memory_order_acquire);
+            if (announced != kInactive && announced != epoch) {
+                return epoch;
+            }
+        }
+        if (global_epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst)) {
+            return epoch + 1;
+        }
+        return epoch;
+    }
+
+    // Move the objects retired at least two epochs ago from `list` to `ready`.
+    static void TakeReady(std::vector<Retired>& list, uint64_t epoch, std::vector<Retired>& ready) {
+        size_t kept = 0;
+        for (const Retired& retired : list) {
+            if (retired.epoch + 2 <= epoch) {
+                ready.push_back(retired);
+            } else {
+                list[kept++] = retired;
+            }
+        }
+        list.resize(kept);
+    }
+
+    // Outlives all threads, so late thread exits can still leave their objects.
+    static Orphans& GetOrphans() {
+        static Orphans* orphans = new Orphans;
+        return *orphans;
+    }
+
+    static inline std::atomic<uint64_t> global_epoch_{0};
+    static inline std::atomic<Record*> records_{nullptr};
+    static inline thread_local Record* current_ = nullptr;
+};
+
+// Marks a read-side critical section. Guards nest.
+class EpochGuard {
+public:
+    EpochGuard() {
+        EpochDomain::Enter();
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+    ~EpochGuard() {
+        EpochDomain::Leave();
+    }
+};
+
+// Deleter for RefCounted, e.g. AtomicRefCounted<Node, EpochDelete>: the object dying with
+// its last IntrusivePtr is retired to the epoch domain instead of being deleted.
+struct EpochDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        EpochDomain::Retire(object);
+    }
+};
+
+// Like MakeShared, but readers may keep using the object under an EpochGuard
+// after the last SharedPtr to it is gone.
+template <typename T, typename Policy = DefaultPolicy, typename... Args>
+SharedPtr<T, Policy> MakeEpochShared(Args&&... args) {
+    auto block = NewBlock<ControlBlockDeferred<T, Policy, EpochDomain>>(
+        DefaultBlockAllocator<T>(), std::forward<Args>(args)...);
+    return SharedPtr<T, Policy>(AdoptBlock(), block->GetPointer(), block);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+// Building blocks shared by BlockPool and ObjectPool: free lists owned by one thread,
+// a depot they trade batches of slots with, and the per-thread registration returning
+// a thread's slots when it exits.
+
+// Singly linked list threaded through the free slots themselves.
+struct FreeList {
+    struct Node {
+        Node* next;
+    };
+
+    void Push(void* ptr) {
+        head = ::new (ptr) Node{head};
+        ++size;
+    }
+
+    void* Pop() {
+        Node* node = head;
+        head = node->next;
+        --size;
+        return node;
+    }
+
+    Node* head = nullptr;
+    size_t size = 0;
+};
+
+// Shared stock of free slots, one list per size class, guarded by a mutex. Threads take
+// and return BatchSize slots at a time. Owner only tells the depots of different pools
+// apart; each one is created on first use and outlives all threads, so late thread exits
+// can still return their slots.
+template <typename Owner, size_t Classes, size_t BatchSize>
+class FreeListDepot {
+public:
+    static FreeListDepot& Get() {
+        static FreeListDepot* depot = new FreeListDepot;
+        return *depot;
+    }
+
+    // A slot from the thread's `list`, refilling it from the depot if it is empty.
+    // Returns null when both are empty.
+    void* Take(size_t size_class, FreeList& list) {
+        if (!list.head) {
+            Refill(size_class, list);
+        }
+        return list.head ? list.Pop() : nullptr;
+    }
+
+    // Put a slot back on the thread's `list`, handing a batch over once it grows too long.
+    void Give(size_t size_class, FreeList& list, void* ptr) {
+        list.Push(ptr);
+        if (list.size > 2 * BatchSize) {
+            Spill(size_class, list, BatchSize);
+        }
+    }
+
+    void Refill(size_t size_class, FreeList& list) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        FreeList& source = lists_[size_class];
+        for (size_t i = 0; i < BatchSize && source.head; ++i) {
+            list.Push(source.Pop());
+        }
+    }
+
+    void Spill(size_t size_class, FreeList& list, size_t count) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (size_t i = 0; i < count && list.head; ++i) {
+            lists_[size_class].Push(list.Pop());
+        }
+    }
+
+    // For threads without a cache. Returns null when the depot is empty.
+    void* Pop(size_t size_class) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        FreeList& list = lists_[size_class];
+        return list.head ? list.Pop() : nullptr;
+    }
+
+    void Push(size_t size_class, void* ptr) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        lists_[size_class].Push(ptr);
+    }
+
+private:
+    FreeListDepot() = default;
+
+    std::mutex mutex_;
+    FreeList lists_[Classes];
+};
+
+// A Cache per thread, created on first use and handed to Exit when the thread exits,
+// e.g. to spill its free lists back into a depot.
+template <typename Cache, void (*Exit)(Cache&)>
+class ThreadCache {
+public:
+    // Returns null while the thread is shutting down.
+    static Cache* Get() {
+        if (current_) {
+            return current_;
+        }
+        static thread_local bool created = false;
+        if (created) {
+            return nullptr;
+        }
+        created = true;
+        thread_local Registration registration;
+        return current_;
+    }
+
+    // The calling thread's cache, without creating one.
+    static Cache* Find() {
+        return current_;
+    }
+
+private:
+    struct Registration {
+        Registration() {
+            current_ = &cache;
+        }
+
+        ~Registration() {
+            current_ = nullptr;
+            Exit(cache);
+        }
+
+        Cache cache;
+    };
+
+    static inline thread_local Cache* current_ = nullptr;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+// Per-type lifetime counters for objects managed by SharedPtr/WeakPtr blocks and by
+// RefCounted. Only maintained when SMART_POINTERS_INSTRUMENT is defined; otherwise the
+// hooks are discarded at compile time and blocks carry no extra field.
+//
+// The first instrumented type registers a handler that prints a leak report
+// (types with live objects or lingering blocks) to stderr at exit.
+#ifdef SMART_POINTERS_INSTRUMENT
+inline constexpr bool kInstrumentTypes = true;
+#else
+inline constexpr bool kInstrumentTypes = false;
+#endif
+
+// Counter values of one type at some point in time.
+struct TypeStatsSnapshot {
+    std::string name;
+    size_t allocs = 0;          // Objects created.
+    size_t frees = 0;           // Objects destroyed.
+    size_t live = 0;            // Objects alive now.
+    size_t peak_live = 0;       // Most objects alive at once.
+    size_t increments = 0;      // Strong references taken.
+    size_t decrements = 0;      // Strong references dropped.
+    size_t weak_increments = 0;
+    size_t weak_decrements = 0;
+    size_t lingering = 0;       // Blocks of dead objects kept only by weak references.
+    size_t peak_lingering = 0;
+};
+
+class TypeStats {
+public:
+    template <typename T>
+    static TypeStats* Get() {
+        static TypeStats* stats = Register(Demangle(typeid(T).name()));
+        return stats;
+    }
+
+    void OnCreate() {
+        allocs_.fetch_add(1, std::memory_order_relaxed);
+        Raise(peak_live_, live_.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    void OnDestroy() {
+        frees_.fetch_add(1, std::memory_order_relaxed);
+        live_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void OnIncrement() {
+        increments_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnDecrement() {
+        decrements_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnWeakIncrement() {
+        weak_increments_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnWeakDecrement() {
+        weak_decrements_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnLinger() {
+        Raise(peak_lingering_, lingering_.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    void OnUnlinger() {
+        lingering_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    TypeStatsSnapshot Snapshot() const {
+        TypeStatsSnapshot snapshot;
+        snapshot.name = name_;
+        snapshot.allocs = allocs_.load(std::memory_order_relaxed);
+        snapshot.frees = frees_.load(std::memory_order_relaxed);
+        snapshot.live = live_.load(std::memory_order_relaxed);
+        snapshot.peak_live = peak_live_.load(std::memory_order_relaxed);
+        snapshot.increments = increments_.load(std::memory_order_relaxed);
+        snapshot.decrements = decrements_.load(std::memory_order_relaxed);
+        snapshot.weak_increments = weak_increments_.load(std::memory_order_relaxed);
+        snapshot.weak_decrements = weak_decrements_.load(std::memory_order_relaxed);
+        snapshot.lingering = lingering_.load(std::memory_order_relaxed);
+        snapshot.peak_lingering = peak_lingering_.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    // All types seen so far, most recently registered first.
+    static std::vector<TypeStatsSnapshot> SnapshotAll() {
+        std::vector<TypeStatsSnapshot> snapshots;
+        for (TypeStats* stats = head_.load(std::memory_order_acquire); stats;
+             stats = stats->next_) {
+            snapshots.push_back(stats->Snapshot());
+        }
+        return snapshots;
+    }
+
+    static void Dump(std::FILE* out) {
+        std::fprintf(out, "type,allocs,frees,live,peak_live,increments,decrements,"
+                          "weak_increments,weak_decrements,lingering,peak_lingering\n");
+        for (const TypeStatsSnapshot& s : SnapshotAll()) {
+            std::fprintf(out, "\"%s\",%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu\n", s.name.c_str(),
+                         s.allocs, s.frees, s.live, s.peak_live, s.increments, s.decrements,
+                         s.weak_increments, s.weak_decrements, s.lingering, s.peak_lingering);
+        }
+    }
+
+    // Print the types that still have live objects or lingering blocks.
+    static void ReportLeaks(std::FILE* out) {
+        for (const TypeStatsSnapshot& s : SnapshotAll()) {
+            if (s.live != 0 || s.lingering != 0) {
+                std::fprintf(out, "leak: %s: %zu live objects, %zu lingering blocks\n",
+                             s.name.c_str(), s.live, s.lingering);
+            }
+        }
+    }
+
+private:
+    explicit TypeStats(std::string name) : name_(std::move(name)) {
+    }
+
+    // Stats are never freed, so that objects dying during static destruction can be counted.
+    static TypeStats* Register(std::string name) {
+        static bool report = (std::atexit([] { ReportLeaks(stderr); }), true);
+        static_cast<void>(report);
+        auto stats = new TypeStats(std::move(name));
+        stats->next_ = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(stats->next_, stats, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+        return stats;
+    }
+
+    static std::string Demangle(const char* name) {
+#if defined(__GNUG__)
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (status == 0) {
+            std::string result(demangled);
+            std::free(demangled);
+            return result;
+        }
+#endif
+        return name;
+    }
+
+    static void Raise(std::atomic<size_t>& peak, size_t value) {
+        size_t current = peak.load(std::memory_order_relaxed);
+        while (current < value &&
+               !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    static inline std::atomic<TypeStats*> head_{nullptr};
+
+    const std::string name_;
+    TypeStats* next_ = nullptr;
+    std::atomic<size_t> allocs_{0};
+    std::atomic<size_t> frees_{0};
+    std::atomic<size_t> live_{0};
+    std::atomic<size_t> peak_live_{0};
+    std::atomic<size_t> increments_{0};
+    std::atomic<size_t> decrements_{0};
+    std::atomic<size_t> weak_increments_{0};
+    std::atomic<size_t> weak_decrements_{0};
+    std::atomic<size_t> lingering_{0};
+    std::atomic<size_t> peak_lingering_{0};
+};
+
+// Stats of T, or null when instrumentation is compiled out.
+template <typename T>
+TypeStats* GetTypeStats() {
+    if constexpr (kInstrumentTypes) {
+        return TypeStats::Get<T>();
+    } else {
+        return nullptr;
+    }
+}
+
+// Holds a block's stats pointer, taking no space when instrumentation is compiled out.
+template <bool kEnabled = kInstrumentTypes>
+class TypeStatsSlot {
+public:
+    explicit TypeStatsSlot(TypeStats*) {
+    }
+
+    TypeStats* GetStats() const {
+        return nullptr;
+    }
+};
+
+template <>
+class TypeStatsSlot<true> {
+public:
+    explicit TypeStatsSlot(TypeStats* stats) : stats_(stats) {
+    }
+
+    TypeStats* GetStats() const {
+        return stats_;
+    }
+
+private:
+    TypeStats* stats_;
+};
+
+// Counts the objects of Derived as they are constructed and destroyed, e.g. for RefCounted.
+// An empty class when instrumentation is compiled out.
+template <typename Derived, bool kEnabled = kInstrumentTypes>
+class CountedLifetime {};
+
+template <typename Derived>
+class CountedLifetime<Derived, true> {
+protected:
+    CountedLifetime() {
+        TypeStats::Get<Derived>()->OnCreate();
+    }
+
+    CountedLifetime(const CountedLifetime&) : CountedLifetime() {
+    }
+
+    CountedLifetime& operator=(const CountedLifetime&) = default;
+
+    ~CountedLifetime() {
+        TypeStats::Get<Derived>()->OnDestroy();
+    }
+};
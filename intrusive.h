@@ -1,6 +1,10 @@
 #pragma once
 
+#include "instrument.h"
+
+#include <atomic>
 #include <cstddef>  // for std::nullptr_t
+#include <mutex>
 #include <utility>  // for std::exchange / std::swap
 
 class SimpleCounter {
@@ -23,6 +27,163 @@ private:
     size_t count_ = 0;
 };
 
+// Thread-safe counter. Copying an object doesn't copy its references, so copies start at zero.
+class AtomicCounter {
+public:
+    AtomicCounter() = default;
+
+    AtomicCounter(const AtomicCounter&) {
+    }
+
+    AtomicCounter& operator=(const AtomicCounter&) {
+        return *this;
+    }
+
+    // A new reference is always made from an existing one, so no ordering is needed.
+    size_t IncRef() {
+        return count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // The release half publishes our writes to the object,
+    // the acquire half lets the last owner see everybody else's before destroying it.
+    size_t DecRef() {
+        return count_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+
+    size_t RefCount() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<size_t> count_ = 0;
+};
+
+inline constexpr size_t kCacheLineSize = 64;
+
+// AtomicCounter on a cache line of its own, so that reference traffic
+// doesn't invalidate hot fields of the object.
+class alignas(kCacheLineSize) PaddedAtomicCounter : public AtomicCounter {};
+
+class WeakAtomicCounter;
+
+// Side table shared by an object and its IntrusiveWeakPtrs. Lives until the object and
+// all weak pointers are gone.
+class WeakReference {
+    friend class WeakAtomicCounter;
+
+public:
+    WeakReference(const WeakReference&) = delete;
+    WeakReference& operator=(const WeakReference&) = delete;
+
+    void AddRef() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    bool Expired() const {
+        return expired_.load(std::memory_order_acquire);
+    }
+
+    // Run `increment` on the object unless it expired; it can't expire in the meantime.
+    template <typename Increment>
+    bool IncrementIfAlive(Increment increment) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return !expired_.load(std::memory_order_relaxed) && increment();
+    }
+
+private:
+    WeakReference() = default;
+
+    // Called once the strong count dropped to zero, before the object is destroyed.
+    void Expire() {
+        std::lock_guard<std::mutex> guard(mutex_);
+        expired_.store(true, std::memory_order_release);
+    }
+
+    std::mutex mutex_;
+    std::atomic<bool> expired_{false};
+    std::atomic<size_t> refs_{1};  // The object's, plus one per weak pointer.
+};
+
+// AtomicCounter that also hands out weak references, for IntrusiveWeakPtr. The side table
+// is allocated by the first weak pointer, so the object only grows by a pointer, and
+// releases keep their single fetch_sub unless the count drops to zero.
+class WeakAtomicCounter {
+public:
+    WeakAtomicCounter() = default;
+
+    // Neither references nor weak references are copied.
+    WeakAtomicCounter(const WeakAtomicCounter&) {
+    }
+
+    WeakAtomicCounter& operator=(const WeakAtomicCounter&) {
+        return *this;
+    }
+
+    ~WeakAtomicCounter() {
+        if (WeakReference* weak = weak_.load(std::memory_order_acquire)) {
+            weak->Expire();
+            weak->Release();
+        }
+    }
+
+    size_t IncRef() {
+        return count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // Weak pointers are made from strong ones, so whoever drops the last strong
+    // reference sees the side table.
+    size_t DecRef() {
+        size_t count = count_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+        if (count == 0) {
+            if (WeakReference* weak = weak_.load(std::memory_order_acquire)) {
+                weak->Expire();
+            }
+        }
+        return count;
+    }
+
+    // Only called through WeakReference::IncrementIfAlive().
+    bool TryIncRef() {
+        size_t count = count_.load(std::memory_order_relaxed);
+        do {
+            if (count == 0) {
+                return false;
+            }
+        } while (!count_.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+        return true;
+    }
+
+    size_t RefCount() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    // Returns the side table with a reference for the caller, who must hold a strong one.
+    WeakReference* GetWeakReference() {
+        WeakReference* weak = weak_.load(std::memory_order_acquire);
+        if (!weak) {
+            auto fresh = new WeakReference;
+            if (weak_.compare_exchange_strong(weak, fresh, std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+                weak = fresh;
+            } else {
+                delete fresh;
+            }
+        }
+        weak->AddRef();
+        return weak;
+    }
+
+private:
+    std::atomic<size_t> count_ = 0;
+    std::atomic<WeakReference*> weak_ = nullptr;
+};
+
 struct DefaultDelete {
     template <typename T>
     static void Destroy(T* object) {
@@ -30,8 +191,10 @@ struct DefaultDelete {
     }
 };
 
+// With SMART_POINTERS_INSTRUMENT defined, objects and reference operations are counted
+// in the TypeStats of Derived.
 template <typename Derived, typename Counter, typename Deleter>
-class RefCounted {
+class RefCounted : private CountedLifetime<Derived> {
 public:
     RefCounted() = default;
 
@@ -41,14 +204,19 @@ public:
 
     // Increase reference counter.
     void IncRef() {
+        if constexpr (kInstrumentTypes) {
+            TypeStats::Get<Derived>()->OnIncrement();
+        }
         counter_.IncRef();
     }
 
     // Decrease reference counter.
     // Destroy object using Deleter when the last instance dies.
     void DecRef() {
-        counter_.DecRef();
-        if (counter_.RefCount() == 0) {
+        if constexpr (kInstrumentTypes) {
+            TypeStats::Get<Derived>()->OnDecrement();
+        }
+        if (counter_.DecRef() == 0) {
             Deleter::Destroy(static_cast<Derived*>(this));
         }
     }
@@ -58,6 +226,22 @@ public:
         return counter_.RefCount();
     }
 
+    // Only with a Counter supporting weak references, e.g. WeakAtomicCounter.
+    WeakReference* GetWeakReference() {
+        return counter_.GetWeakReference();
+    }
+
+    // Take a strong reference unless the count already dropped to zero.
+    bool TryIncRef() {
+        if (!counter_.TryIncRef()) {
+            return false;
+        }
+        if constexpr (kInstrumentTypes) {
+            TypeStats::Get<Derived>()->OnIncrement();
+        }
+        return true;
+    }
+
 private:
     Counter counter_;
 };
@@ -65,11 +249,31 @@ private:
 template <typename Derived, typename D = DefaultDelete>
 using SimpleRefCounted = RefCounted<Derived, SimpleCounter, D>;
 
+template <typename Derived, typename D = DefaultDelete>
+using AtomicRefCounted = RefCounted<Derived, AtomicCounter, D>;
+
+template <typename Derived, typename D = DefaultDelete>
+using PaddedRefCounted = RefCounted<Derived, PaddedAtomicCounter, D>;
+
+// Opt-in: only these objects can be observed through IntrusiveWeakPtr.
+template <typename Derived, typename D = DefaultDelete>
+using WeakRefCounted = RefCounted<Derived, WeakAtomicCounter, D>;
+
+template <typename T>
+class IntrusiveWeakPtr;
+
+class BatchReleaser;
+
 template <typename T>
 class IntrusivePtr {
     template <typename Y>
     friend class IntrusivePtr;
 
+    template <typename Y>
+    friend class IntrusiveWeakPtr;
+
+    friend class BatchReleaser;
+
 public:
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Constructors
@@ -179,4 +383,97 @@ IntrusivePtr<T> MakeIntrusive(Args&&... args) {
     intrusive_ptr.ptr_ = ptr;
     ptr->IncRef();
     return intrusive_ptr;
-}
\ No newline at end of file
+}
+// Weak counterpart of IntrusivePtr for WeakRefCounted objects: holds the object's side table
+// rather than a reference, and Lock() hands out an IntrusivePtr while the object lives.
+template <typename T>
+class IntrusiveWeakPtr {
+    template <typename Y>
+    friend class IntrusiveWeakPtr;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    IntrusiveWeakPtr() : ptr_(nullptr), weak_(nullptr) {
+    }
+
+    IntrusiveWeakPtr(std::nullptr_t) : IntrusiveWeakPtr() {
+    }
+
+    template <typename Y>
+    IntrusiveWeakPtr(const IntrusivePtr<Y>& other)
+        : ptr_(other.Get()), weak_(ptr_ ? ptr_->GetWeakReference() : nullptr) {
+    }
+
+    IntrusiveWeakPtr(const IntrusiveWeakPtr& other) : ptr_(other.ptr_), weak_(other.weak_) {
+        if (weak_) {
+            weak_->AddRef();
+        }
+    }
+
+    template <typename Y>
+    IntrusiveWeakPtr(const IntrusiveWeakPtr<Y>& other) : ptr_(other.ptr_), weak_(other.weak_) {
+        if (weak_) {
+            weak_->AddRef();
+        }
+    }
+
+    IntrusiveWeakPtr(IntrusiveWeakPtr&& other)
+        : ptr_(std::exchange(other.ptr_, nullptr)), weak_(std::exchange(other.weak_, nullptr)) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // operator=-s
+    IntrusiveWeakPtr& operator=(const IntrusiveWeakPtr& other) {
+        IntrusiveWeakPtr(other).Swap(*this);
+        return *this;
+    }
+
+    IntrusiveWeakPtr& operator=(IntrusiveWeakPtr&& other) {
+        IntrusiveWeakPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    template <typename Y>
+    IntrusiveWeakPtr& operator=(const IntrusivePtr<Y>& other) {
+        IntrusiveWeakPtr(other).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~IntrusiveWeakPtr() {
+        if (weak_) {
+            weak_->Release();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Reset() {
+        IntrusiveWeakPtr().Swap(*this);
+    }
+
+    void Swap(IntrusiveWeakPtr& other) {
+        std::swap(ptr_, other.ptr_);
+        std::swap(weak_, other.weak_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    bool Expired() const {
+        return !weak_ || weak_->Expired();
+    }
+
+    IntrusivePtr<T> Lock() const {
+        IntrusivePtr<T> locked;
+        if (weak_ && weak_->IncrementIfAlive([this] { return ptr_->TryIncRef(); })) {
+            locked.ptr_ = ptr_;
+        }
+        return locked;
+    }
+
+private:
+    T* ptr_;
+    WeakReference* weak_;
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "unique.h"
+
+#include <cerrno>
+#include <cstddef>  // std::nullptr_t
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pointer stored as the distance from itself to the target, so that a structure linked with
+// OffsetPtrs stays valid wherever its memory is mapped. Copies recompute the distance; null
+// is encoded as 1, which never separates two suitably aligned objects.
+template <typename T>
+class OffsetPtr {
+    template <typename U>
+    friend class OffsetPtr;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    OffsetPtr() noexcept : offset_(kNull) {
+    }
+
+    OffsetPtr(std::nullptr_t) noexcept : OffsetPtr() {
+    }
+
+    OffsetPtr(T* ptr) noexcept : offset_(ToOffset(ptr)) {
+    }
+
+    OffsetPtr(const OffsetPtr& other) noexcept : offset_(ToOffset(other.Get())) {
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    OffsetPtr(const OffsetPtr<U>& other) noexcept : offset_(ToOffset(other.Get())) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+    OffsetPtr& operator=(const OffsetPtr& other) noexcept {
+        offset_ = ToOffset(other.Get());
+        return *this;
+    }
+
+    OffsetPtr& operator=(T* ptr) noexcept {
+        offset_ = ToOffset(ptr);
+        return *this;
+    }
+
+    OffsetPtr& operator=(std::nullptr_t) noexcept {
+        offset_ = kNull;
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    T* Get() const noexcept {
+        if (offset_ == kNull) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(this) + offset_);
+    }
+
+    std::add_lvalue_reference_t<T> operator*() const noexcept {
+        return *Get();
+    }
+
+    T* operator->() const noexcept {
+        return Get();
+    }
+
+    template <typename U = T>
+    std::add_lvalue_reference_t<U> operator[](ptrdiff_t index) const noexcept {
+        return Get()[index];
+    }
+
+    explicit operator bool() const noexcept {
+        return offset_ != kNull;
+    }
+
+private:
+    static constexpr intptr_t kNull = 1;
+
+    intptr_t ToOffset(const volatile void* ptr) const {
+        if (!ptr) {
+            return kNull;
+        }
+        return static_cast<intptr_t>(reinterpret_cast<uintptr_t>(ptr) -
+                                     reinterpret_cast<uintptr_t>(this));
+    }
+
+    intptr_t offset_;
+};
+
+template <typename T, typename U>
+bool operator==(const OffsetPtr<T>& left, const OffsetPtr<U>& right) {
+    return left.Get() == right.Get();
+}
+
+template <typename T, typename U>
+bool operator!=(const OffsetPtr<T>& left, const OffsetPtr<U>& right) {
+    return !(left == right);
+}
+
+template <typename T>
+bool operator==(const OffsetPtr<T>& ptr, std::nullptr_t) {
+    return !ptr;
+}
+
+template <typename T>
+bool operator!=(const OffsetPtr<T>& ptr, std::nullptr_t) {
+    return static_cast<bool>(ptr);
+}
+
+class MappedRegion;
+
+// Unmaps a region made by MapFile. Dirty pages reach the file through the shared mapping.
+struct MunmapDeleter {
+    void operator()(MappedRegion* region) const;
+};
+
+using MappedFile = UniquePtr<MappedRegion, MunmapDeleter>;
+
+inline MappedFile MapFile(const char* path, size_t size);
+
+// Bump allocator over a mapped file, living at the start of the mapping. Like an Arena,
+// nothing is freed one by one: the space of dead objects is only reused by a new file.
+// The root object is reachable through GetRoot() when the file is mapped again.
+class MappedRegion {
+public:
+    MappedRegion(const MappedRegion&) = delete;
+    MappedRegion& operator=(const MappedRegion&) = delete;
+
+    // `alignment` must be a power of two; throws std::bad_alloc when the region is full.
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+        if (offset > size_ || size > size_ - offset) {
+            throw std::bad_alloc();
+        }
+        used_ = offset + size;
+        return reinterpret_cast<unsigned char*>(this) + offset;
+    }
+
+    template <typename T, typename... Args>
+    T* Create(Args&&... args) {
+        return ::new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* GetRoot() const {
+        return static_cast<T*>(root_.Get());
+    }
+
+    void SetRoot(void* root) {
+        root_ = root;
+    }
+
+    size_t GetSize() const {
+        return size_;
+    }
+
+    size_t GetUsed() const {
+        return used_;
+    }
+
+private:
+    friend struct MunmapDeleter;
+    friend MappedFile MapFile(const char* path, size_t size);
+
+    static constexpr uint64_t kMagic = 0x6e6f6967655270ull;  // "pRegion"
+
+    explicit MappedRegion(size_t size) : size_(size), used_(sizeof(MappedRegion)) {
+    }
+
+    uint64_t magic_ = kMagic;
+    uint64_t size_;
+    uint64_t used_;
+    OffsetPtr<void> root_;
+};
+
+inline void MunmapDeleter::operator()(MappedRegion* region) const {
+    ::munmap(region, region->size_);
+}
+
+// Deleter for objects inside a MappedRegion, for owning links that stay valid across
+// mappings: UniquePtr<Node, MappedDeleter<Node>> stores an OffsetPtr<Node>. Runs the
+// destructor only, the region keeps the memory.
+template <typename T>
+struct MappedDeleter {
+    using pointer = OffsetPtr<T>;
+
+    MappedDeleter() = default;
+
+    template <typename U>
+    MappedDeleter(const MappedDeleter<U>&) {
+    }
+
+    void operator()(OffsetPtr<T> ptr) {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            ptr->~T();
+        }
+    }
+};
+
+template <typename T>
+using MappedPtr = UniquePtr<T, MappedDeleter<T>>;
+
+// Map `path` read-write, creating it with `size` bytes if it is new or empty. An existing
+// region is mapped with the size it was created with; any other file is left alone.
+// Throws std::system_error, with EINVAL for files that aren't (whole) regions.
+inline MappedFile MapFile(const char* path, size_t size) {
+    int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    auto fail = [fd, path] {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    };
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        fail();
+    }
+    bool fresh = info.st_size == 0;
+    if (fresh) {
+        if (size < sizeof(MappedRegion)) {
+            size = sizeof(MappedRegion);
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            fail();
+        }
+    } else {
+        uint64_t header[2];  // magic_ and size_
+        ssize_t read = ::pread(fd, header, sizeof(header), 0);
+        if (read < 0) {
+            fail();
+        }
+        // A region cut short would raise SIGBUS on access past the end of the file.
+        if (static_cast<size_t>(read) < sizeof(header) || header[0] != MappedRegion::kMagic ||
+            header[1] < sizeof(MappedRegion) ||
+            header[1] > static_cast<uint64_t>(info.st_size)) {
+            errno = EINVAL;
+            fail();
+        }
+        size = header[1];
+    }
+    void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        fail();
+    }
+    ::close(fd);
+    auto region = static_cast<MappedRegion*>(memory);
+    if (fresh) {
+        ::new (memory) MappedRegion(size);
+    }
+    return MappedFile(region);
+}
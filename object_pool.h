@@ -0,0 +1,129 @@
+#pragma once
+
+#include "free_list.h"
+#include "intrusive.h"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Recycles the storage of T objects: a free list per thread plus a shared depot, trading
+// kBatchSize slots at a time like BlockPool does. Slots are plain operator new memory and
+// are never returned to the system, so the pool stays as large as its peak population.
+template <typename T>
+class ObjectPool {
+public:
+    static constexpr size_t kBatchSize = 32;
+
+    struct Stats {
+        size_t hits = 0;    // Allocations served from a free list.
+        size_t misses = 0;  // Allocations that had to go to operator new.
+    };
+
+    static void* Allocate() {
+        Cache* cache = Caches::Get();
+        if (!cache) {
+            if (void* slot = GetDepot().Pop(0)) {
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return slot;
+            }
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return NewSlot();
+        }
+        void* slot = GetDepot().Take(0, cache->list);
+        if (slot) {
+            ++cache->hits;
+        } else {
+            slot = NewSlot();
+            ++cache->misses;
+        }
+        if (cache->hits + cache->misses == kBatchSize) {
+            Report(*cache);
+        }
+        return slot;
+    }
+
+    static void Deallocate(void* ptr) {
+        Cache* cache = Caches::Find();
+        if (!cache) {
+            GetDepot().Push(0, ptr);
+            return;
+        }
+        GetDepot().Give(0, cache->list, ptr);
+    }
+
+    // Threads report their counts every kBatchSize allocations,
+    // so each running thread may lag behind by up to a batch.
+    static Stats GetStats() {
+        Stats stats;
+        stats.hits = hits_.load(std::memory_order_relaxed);
+        stats.misses = misses_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    using Depot = FreeListDepot<ObjectPool, 1, kBatchSize>;
+
+    struct Cache {
+        FreeList list;
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+
+    static void Report(Cache& cache) {
+        hits_.fetch_add(std::exchange(cache.hits, 0), std::memory_order_relaxed);
+        misses_.fetch_add(std::exchange(cache.misses, 0), std::memory_order_relaxed);
+    }
+
+    // Hands the thread's slots back to the depot when the thread exits.
+    static void ReturnCache(Cache& cache) {
+        Report(cache);
+        GetDepot().Spill(0, cache.list, cache.list.size);
+    }
+
+    using Caches = ThreadCache<Cache, &ReturnCache>;
+
+    static constexpr size_t kSlotSize =
+        sizeof(T) > sizeof(FreeList::Node) ? sizeof(T) : sizeof(FreeList::Node);
+    static constexpr size_t kSlotAlignment =
+        alignof(T) > alignof(FreeList::Node) ? alignof(T) : alignof(FreeList::Node);
+
+    static void* NewSlot() {
+        return ::operator new(kSlotSize, std::align_val_t(kSlotAlignment));
+    }
+
+    static Depot& GetDepot() {
+        return Depot::Get();
+    }
+
+    static inline std::atomic<size_t> hits_{0};
+    static inline std::atomic<size_t> misses_{0};
+};
+
+// Deleter for RefCounted, e.g. AtomicRefCounted<Message, PoolDelete>: the dead object's
+// storage goes back to ObjectPool<Derived>. Objects have to come from that pool, i.e. from
+// MakeIntrusive<Derived>(FromPool(), ...), and not be of a class derived from Derived.
+struct PoolDelete {
+    template <typename T>
+    static void Destroy(T* object) {
+        object->~T();
+        ObjectPool<T>::Deallocate(object);
+    }
+};
+
+// Selects the MakeIntrusive overload taking storage from ObjectPool<T>.
+struct FromPool {};
+
+template <typename T, typename... Args>
+IntrusivePtr<T> MakeIntrusive(FromPool, Args&&... args) {
+    void* slot = ObjectPool<T>::Allocate();
+    T* ptr;
+    try {
+        ptr = ::new (slot) T(std::forward<Args>(args)...);
+    } catch (...) {
+        ObjectPool<T>::Deallocate(slot);
+        throw;
+    }
+    return IntrusivePtr<T>(ptr);
+}
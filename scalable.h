@@ -0,0 +1,207 @@
+#pragma once
+
+#include "intrusive.h"  // kCacheLineSize
+#include "shared.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Sharded reference counting policy for a few extremely hot objects copied on every core:
+// SharedPtr<T, Sharded>, usually made by MakeSharedScalable<T>(...).
+//
+// Threads are spread over kSlots counters, each on a cache line of its own, so copies and
+// releases on different cores don't touch a common line. The central word counts the
+// references taken directly (the first one and those locked from a WeakPtr) plus one per
+// attached slot, like the arrive/depart surplus of a SNZI node: it only reaches zero once
+// every slot is detached. Slots stay attached while empty, so the steady state of copies
+// and releases on one thread never writes the central word.
+//
+// The counts are reconciled when the last direct reference goes: that thread marks every
+// slot as draining and detaches the empty ones. From then on a draining slot detaches
+// itself as it empties, and the last detachment kills the object.
+//
+// Releasing a reference made on another thread takes it from some other slot, or from the
+// direct count, which costs a few shared cache lines. Each block takes kSlots cache lines.
+struct Sharded {};
+
+template <>
+class RefCounts<Sharded> {
+public:
+    static constexpr size_t kSlots = 32;
+
+    void Increment() {
+        std::atomic<int64_t>& slot = slots_[GetSlotIndex()].value;
+        int64_t value = slot.load(std::memory_order_relaxed);
+        while (true) {
+            if (value != kDetached) {
+                if (slot.compare_exchange_weak(value, value + 1, std::memory_order_relaxed)) {
+                    return;
+                }
+                continue;
+            }
+            // Attach before the slot shows a count: the central word may over-count for
+            // a moment, but never under-count.
+            central_.fetch_add(kStrongOne, std::memory_order_relaxed);
+            if (slot.compare_exchange_strong(value, 1)) {
+                // Attached after the counts were reconciled: drain like the others.
+                if (direct_.load() == 0) {
+                    MarkDraining(slot);
+                }
+                return;
+            }
+            // Somebody else attached it. Our source reference keeps the word above zero.
+            central_.fetch_sub(kStrongOne, std::memory_order_relaxed);
+        }
+    }
+
+    void IncrementWeak() {
+        central_.fetch_add(kWeakOne, std::memory_order_relaxed);
+    }
+
+    // Take a direct reference unless the object is already dead.
+    bool IncrementIfNotZero() {
+        uint64_t counts = central_.load(std::memory_order_relaxed);
+        do {
+            if (Strong(counts) == 0) {
+                return false;
+            }
+        } while (!central_.compare_exchange_weak(counts, counts + kStrongOne,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_relaxed));
+        direct_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Nothing may touch the block once our reference is gone, unless the object is dead:
+    // the central word is always the last thing written.
+    Released Release() {
+        size_t index = GetSlotIndex();
+        bool detached = false;
+        if (Take(slots_[index].value, detached)) {
+            return detached ? DropAttachment() : Released::kAlive;
+        }
+        // Made on another thread: our reference is counted in another slot or directly.
+        // Slots go first, so that references moving between threads don't use up the
+        // direct count while the long-lived owners still hold it.
+        while (true) {
+            for (size_t i = 1; i <= kSlots; ++i) {
+                if (Take(slots_[(index + i) % kSlots].value, detached)) {
+                    return detached ? DropAttachment() : Released::kAlive;
+                }
+            }
+            int64_t direct = direct_.load(std::memory_order_relaxed);
+            while (direct > 0) {
+                if (direct_.compare_exchange_weak(direct, direct - 1)) {
+                    // Our share of the central word still pins the block.
+                    if (direct == 1) {
+                        Drain();
+                    }
+                    return DropAttachment();
+                }
+            }
+        }
+    }
+
+    // Returns true when the block is no longer referenced.
+    bool ReleaseWeak() {
+        return central_.fetch_sub(kWeakOne, std::memory_order_acq_rel) == kWeakOne;
+    }
+
+    // Exact only while no other thread touches the pointers.
+    size_t GetReferenceCount() const {
+        int64_t count = direct_.load(std::memory_order_relaxed);
+        for (const Slot& slot : slots_) {
+            int64_t value = slot.value.load(std::memory_order_relaxed);
+            if (value != kDetached) {
+                count += Count(value);
+            }
+        }
+        return count;
+    }
+
+    size_t GetWeakCount() const {
+        uint64_t counts = central_.load(std::memory_order_relaxed);
+        return Weak(counts) - (Strong(counts) != 0);
+    }
+
+private:
+    // A slot holds its count, plus kDraining once the counts have been reconciled.
+    static constexpr int64_t kDetached = -1;
+    static constexpr int64_t kDraining = int64_t{1} << 62;
+    static constexpr uint64_t kStrongOne = 1;
+    static constexpr uint64_t kWeakOne = uint64_t{1} << 32;
+
+    struct alignas(kCacheLineSize) Slot {
+        std::atomic<int64_t> value{kDetached};
+    };
+
+    static int64_t Count(int64_t value) {
+        return value & (kDraining - 1);
+    }
+
+    static size_t Strong(uint64_t counts) {
+        return counts & (kWeakOne - 1);
+    }
+
+    static size_t Weak(uint64_t counts) {
+        return counts >> 32;
+    }
+
+    // Threads are dealt slots round-robin.
+    static size_t GetSlotIndex() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kSlots;
+        return index;
+    }
+
+    // Drop a reference counted in `slot`, if it has any. A draining slot is detached
+    // instead of emptied, and the caller then owes the central word its attachment.
+    static bool Take(std::atomic<int64_t>& slot, bool& detached) {
+        int64_t value = slot.load(std::memory_order_relaxed);
+        while (value != kDetached && Count(value) > 0) {
+            detached = value == (kDraining | 1);
+            if (slot.compare_exchange_weak(value, detached ? kDetached : value - 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Released DropAttachment() {
+        if (Strong(central_.fetch_sub(kStrongOne, std::memory_order_acq_rel)) == 1) {
+            return Released::kObjectDead;
+        }
+        return Released::kAlive;
+    }
+
+    // Called with the last direct reference gone but still counted centrally.
+    // The sequentially consistent accesses pair with the attach in Increment(): a slot
+    // attached concurrently is either marked here or sees no direct references there.
+    void Drain() {
+        for (Slot& slot : slots_) {
+            MarkDraining(slot.value);
+        }
+    }
+
+    // The caller keeps the central word above zero, so detaching can't kill the object.
+    void MarkDraining(std::atomic<int64_t>& slot) {
+        int64_t empty = kDraining;
+        if (slot.fetch_or(kDraining) == 0 && slot.compare_exchange_strong(empty, kDetached)) {
+            central_.fetch_sub(kStrongOne, std::memory_order_acq_rel);
+        }
+    }
+
+    // Strong half: direct references plus attached slots. Weak half as in RefCounts.
+    std::atomic<uint64_t> central_{kStrongOne + kWeakOne};
+    std::atomic<int64_t> direct_{1};
+    Slot slots_[kSlots];
+};
+
+// MakeShared with sharded counts. Sharding is a policy of its own rather than a flag on the
+// block, so that SharedPtr<T> keeps its branch-free single-word counts.
+template <typename T, typename... Args>
+SharedPtr<T, Sharded> MakeSharedScalable(Args&&... args) {
+    return MakeShared<T, Sharded>(std::forward<Args>(args)...);
+}
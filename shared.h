@@ -7,18 +7,39 @@
 
 class ESFTBase {};
 
-template <typename T>
+// Selects the SharedPtr constructor that adopts a freshly created control block,
+// for factories building blocks of their own (AllocateShared, MakeEpochShared, ...).
+struct AdoptBlock {};
+
+template <typename T, typename Policy>
 class SharedPtr {
-    template <typename Y>
+    template <typename Y, typename P>
     friend class SharedPtr;
 
-    template <typename Y>
+    template <typename Y, typename P>
     friend class WeakPtr;
 
-    template <typename Y>
+    template <typename Y, typename P>
     friend class EnableSharedFromThis;
 
+    template <typename Y>
+    friend class AtomicSharedPtr;
+
+    friend class BatchReleaser;
+
+    template <typename Y, typename P>
+    friend class ThinSharedPtr;
+
+    template <typename Y, typename P, typename... Args>
+    friend CompressedSharedPtr<Y, P> MakeCompressedShared(Args&&... args);
+
+    template <typename Deleter, typename Y, typename P>
+    friend Deleter* GetDeleter(const SharedPtr<Y, P>& ptr) noexcept;
+
 public:
+    // SharedPtr<T[]> points to the first element.
+    using ElementType = std::remove_extent_t<T>;
+
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Constructors
 
@@ -28,19 +49,64 @@ public:
     constexpr SharedPtr(std::nullptr_t) noexcept : SharedPtr() {
     }
 
-    explicit SharedPtr(T* ptr) noexcept : observed_(ptr), block_(new ControlBlockPointer<T>(ptr)) {
-        AddRef();
-        if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-            observed_->weak_this_ = *this;
+    // If the block can't be allocated, `ptr` is deleted before the exception propagates.
+    explicit SharedPtr(ElementType* ptr) : observed_(ptr), block_(nullptr) {
+        try {
+            block_ = NewBlock<ControlBlockPointer<T, Policy>>(DefaultBlockAllocator<ElementType>(),
+                                                              ptr);
+        } catch (...) {
+            DefaultDeleter<T>()(ptr);
+            throw;
         }
+        EnableSharedFrom(ptr);
     }
 
     template <typename Y>
-    explicit SharedPtr(Y* ptr) noexcept : observed_(ptr), block_(new ControlBlockPointer<Y>(ptr)) {
-        AddRef();
-        if constexpr (std::is_convertible_v<Y*, ESFTBase*>) {
-            observed_->weak_this_ = *this;
+    explicit SharedPtr(Y* ptr) : observed_(ptr), block_(nullptr) {
+        try {
+            block_ = NewBlock<ControlBlockPointer<Y, Policy>>(DefaultBlockAllocator<Y>(), ptr);
+        } catch (...) {
+            DefaultDeleter<Y>()(ptr);
+            throw;
+        }
+        EnableSharedFrom(ptr);
+    }
+
+    // `deleter(ptr)` disposes of the object; if the block can't be allocated, it is
+    // called right away. The deleter and the allocator are kept inside the block.
+    template <typename Y, typename Deleter>
+    SharedPtr(Y* ptr, Deleter deleter)
+            : SharedPtr(ptr, std::move(deleter), DefaultBlockAllocator<std::remove_extent_t<Y>>()) {
+    }
+
+    template <typename Y, typename Deleter, typename Alloc>
+    SharedPtr(Y* ptr, Deleter deleter, const Alloc& alloc) : observed_(ptr), block_(nullptr) {
+        try {
+            block_ = NewBlock<ControlBlockPointer<Y, Policy, Deleter, Alloc>>(alloc, ptr, deleter);
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+        EnableSharedFrom(ptr);
+    }
+
+    // Takes the object and the deleter over; `other` stays untouched if this throws.
+    template <typename Y, typename Deleter>
+    SharedPtr(UniquePtr<Y, Deleter>&& other) : observed_(other.Get()), block_(nullptr) {
+        if (!other) {
+            return;
         }
+        using Block = ControlBlockPointer<Y, Policy, Deleter>;
+        block_ = NewBlock<Block>(DefaultBlockAllocator<std::remove_extent_t<Y>>(), other.Get(),
+                                 std::move(other.GetDeleter()));
+        EnableSharedFrom(other.Release());
+    }
+
+    // Takes over a strong reference the caller holds on `block`.
+    // A fresh object deriving from EnableSharedFromThis gets hooked up to the block.
+    SharedPtr(AdoptBlock, ElementType* ptr, ControlBlockBase<Policy>* block) noexcept
+            : observed_(ptr), block_(block) {
+        EnableSharedFrom(observed_);
     }
 
     SharedPtr(const SharedPtr& other) noexcept : observed_(other.observed_), block_(other.block_) {
@@ -48,69 +114,60 @@ public:
     }
 
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other) noexcept
+    SharedPtr(const SharedPtr<Y, Policy>& other) noexcept
             : observed_(other.observed_), block_(other.block_) {
         AddRef();
     }
 
-    SharedPtr(SharedPtr&& other) noexcept : observed_(other.observed_), block_(other.block_) {
-        AddRef();
-        other.Reset();
+    // Moves hand the reference over without touching the counts.
+    SharedPtr(SharedPtr&& other) noexcept
+            : observed_(std::exchange(other.observed_, nullptr)),
+              block_(std::exchange(other.block_, nullptr)) {
     }
 
     template <typename Y>
-    SharedPtr(SharedPtr<Y>&& other) noexcept : observed_(other.observed_), block_(other.block_) {
-        AddRef();
-        other.Reset();
+    SharedPtr(SharedPtr<Y, Policy>&& other) noexcept
+            : observed_(std::exchange(other.observed_, nullptr)),
+              block_(std::exchange(other.block_, nullptr)) {
     }
 
     template <typename Y>
-    SharedPtr(const SharedPtr<Y>& other, T* ptr) noexcept : observed_(ptr), block_(other.block_) {
+    SharedPtr(const SharedPtr<Y, Policy>& other, ElementType* ptr) noexcept
+            : observed_(ptr), block_(other.block_) {
         AddRef();
     }
 
     template <typename Y>
-    SharedPtr(SharedPtr<Y>&& other, T* ptr) noexcept : observed_(ptr), block_(other.block_) {
-        AddRef();
-        other.Reset();
+    SharedPtr(SharedPtr<Y, Policy>&& other, ElementType* ptr) noexcept
+            : observed_(ptr), block_(std::exchange(other.block_, nullptr)) {
+        other.observed_ = nullptr;
     }
 
-    explicit SharedPtr(const WeakPtr<T>& other) {
-        if (other.Expired()) {
+    explicit SharedPtr(const WeakPtr<T, Policy>& other) {
+        if (!other.block_ || !other.block_->IncrementIfNotZero()) {
             throw BadWeakPtr();
         }
         observed_ = other.observed_;
         block_ = other.block_;
-        AddRef();
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
     SharedPtr& operator=(const SharedPtr& other) noexcept {
-        SharedPtr<T>(other).Swap(*this);
+        SharedPtr(other).Swap(*this);
         return *this;
     }
 
     SharedPtr& operator=(SharedPtr&& other) noexcept {
-        SharedPtr<T>(std::move(other)).Swap(*this);
+        SharedPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Destructor
     ~SharedPtr() {
-        if (!block_) {
-            return;
-        }
-
-        block_->Decrement();
-        if (block_->GetReferenceCount() == 0 && block_->GetWeakCount() == 0) {
-            block_->DeleteObject();
-            delete block_;
-            return;
-        }
-        if (block_->GetReferenceCount() == 0) {
-            block_->DeleteObject();
+        if (block_) {
+            block_->Release();
         }
     }
 
@@ -120,12 +177,12 @@ public:
         SharedPtr().Swap(*this);
     }
 
-    void Reset(T* ptr) noexcept {
-        SharedPtr<T>(ptr).Swap(*this);
+    void Reset(ElementType* ptr) {
+        SharedPtr(ptr).Swap(*this);
     }
 
     template <typename Y>
-    void Reset(Y* ptr) noexcept {
+    void Reset(Y* ptr) {
         SharedPtr(ptr).Swap(*this);
     }
 
@@ -136,18 +193,22 @@ public:
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Observers
-    T* Get() const noexcept {
+    ElementType* Get() const noexcept {
         return observed_;
     }
 
-    T& operator*() const noexcept {
+    std::add_lvalue_reference_t<ElementType> operator*() const noexcept {
         return *Get();
     }
 
-    T* operator->() const noexcept {
+    ElementType* operator->() const noexcept {
         return Get();
     }
 
+    std::add_lvalue_reference_t<ElementType> operator[](ptrdiff_t index) const noexcept {
+        return Get()[index];
+    }
+
     size_t UseCount() const noexcept {
         if (!block_) {
             return 0;
@@ -164,61 +225,108 @@ public:
     }
 
     template <class Y>
-    bool OwnerBefore(const SharedPtr<Y>& other) const noexcept {
+    bool OwnerBefore(const SharedPtr<Y, Policy>& other) const noexcept {
         return block_ == other.block_;
     }
 
     template <class Y>
-    bool OwnerBefore(const WeakPtr<Y>& other) const noexcept {
+    bool OwnerBefore(const WeakPtr<Y, Policy>& other) const noexcept {
         return block_ == other.block_;
     }
 
-    template <typename Y, typename... Args>
-    friend SharedPtr<Y> MakeShared(Args&&... args);
-
 private:
     void AddRef() {
         if (block_) {
             block_->Increment();
         }
     }
-    T* observed_;
-    ControlBlockBase* block_;
+
+    // `ptr` may be a derived object held through a base class pointer, so the hook gets
+    // an alias of its own type.
+    template <typename Y>
+    void EnableSharedFrom(Y* ptr) {
+        if constexpr (std::is_convertible_v<Y*, ESFTBase*>) {
+            if (ptr && ptr->weak_this_.Expired()) {
+                ptr->weak_this_ = SharedPtr<Y, Policy>(*this, ptr);
+            }
+        }
+    }
+
+    ElementType* observed_;
+    ControlBlockBase<Policy>* block_;
 };
 
-template <typename T, typename U>
-inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
+template <typename T, typename U, typename Policy>
+inline bool operator==(const SharedPtr<T, Policy>& left, const SharedPtr<U, Policy>& right) {
     return left.Get() == right.Get();
 }
 
-template <typename T, typename... Args>
-SharedPtr<T> MakeShared(Args&&... args) {
-    SharedPtr<T> shared_ptr;
-    auto control_block_holder = new ControlBlockHolder<T>(std::forward<Args>(args)...);
-    shared_ptr.block_ = control_block_holder;
-    shared_ptr.observed_ = control_block_holder->GetPointer();
-    shared_ptr.block_->Increment();
-    if constexpr (std::is_convertible_v<T*, ESFTBase*>) {
-        shared_ptr.observed_->weak_this_ = shared_ptr;
-    }
-    return shared_ptr;
+// The deleter `ptr` was created with, if it has type Deleter, null otherwise.
+template <typename Deleter, typename T, typename Policy>
+Deleter* GetDeleter(const SharedPtr<T, Policy>& ptr) noexcept {
+    if (!ptr.block_) {
+        return nullptr;
+    }
+    return static_cast<Deleter*>(ptr.block_->GetDeleter(typeid(Deleter)));
+}
+
+// Like MakeShared, but the block (and the object inside it) comes from `alloc`.
+template <typename T, typename Policy, typename Alloc, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, SharedPtr<T, Policy>> AllocateShared(const Alloc& alloc,
+                                                                           Args&&... args) {
+    auto block = NewBlock<ControlBlockHolder<T, Policy, Alloc>>(alloc, std::forward<Args>(args)...);
+    return SharedPtr<T, Policy>(AdoptBlock(), block->GetPointer(), block);
+}
+
+// `count` value-initialized elements, allocated together with the block.
+template <typename T, typename Policy, typename Alloc>
+std::enable_if_t<kIsUnboundedArray<T>, SharedPtr<T, Policy>> AllocateShared(const Alloc& alloc,
+                                                                            size_t count) {
+    auto block = ControlBlockArray<T, Policy, Alloc>::New(alloc, count);
+    return SharedPtr<T, Policy>(AdoptBlock(), block->GetPointer(), block);
+}
+
+template <typename T, typename Policy, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, SharedPtr<T, Policy>> MakeShared(Args&&... args) {
+    return AllocateShared<T, Policy>(DefaultBlockAllocator<T>(), std::forward<Args>(args)...);
+}
+
+template <typename T, typename Policy>
+std::enable_if_t<kIsUnboundedArray<T>, SharedPtr<T, Policy>> MakeShared(size_t count) {
+    return AllocateShared<T, Policy>(DefaultBlockAllocator<std::remove_extent_t<T>>(), count);
+}
+
+// Like MakeShared, but the object is default-initialized: trivial types are left
+// uninitialized, e.g. for buffers that are about to be overwritten anyway.
+template <typename T, typename Policy = DefaultPolicy>
+std::enable_if_t<!std::is_array_v<T>, SharedPtr<T, Policy>> MakeSharedForOverwrite() {
+    auto block = NewBlock<ControlBlockHolder<T, Policy>>(DefaultBlockAllocator<T>(), DefaultInit());
+    return SharedPtr<T, Policy>(AdoptBlock(), block->GetPointer(), block);
+}
+
+template <typename T, typename Policy = DefaultPolicy>
+std::enable_if_t<kIsUnboundedArray<T>, SharedPtr<T, Policy>> MakeSharedForOverwrite(
+    size_t count) {
+    auto block = ControlBlockArray<T, Policy>::New(
+        DefaultBlockAllocator<std::remove_extent_t<T>>(), count, DefaultInit());
+    return SharedPtr<T, Policy>(AdoptBlock(), block->GetPointer(), block);
 }
 
-template <typename T>
+template <typename T, typename Policy>
 class EnableSharedFromThis : public ESFTBase {
 public:
-    SharedPtr<T> SharedFromThis() {
-        return SharedPtr<T>(weak_this_);
+    SharedPtr<T, Policy> SharedFromThis() {
+        return SharedPtr<T, Policy>(weak_this_);
     }
-    SharedPtr<const T> SharedFromThis() const {
-        return SharedPtr<const T>(weak_this_);
+    SharedPtr<const T, Policy> SharedFromThis() const {
+        return SharedPtr<const T, Policy>(weak_this_);
     }
 
-    WeakPtr<T> WeakFromThis() noexcept {
+    WeakPtr<T, Policy> WeakFromThis() noexcept {
         return weak_this_;
     }
-    WeakPtr<const T> WeakFromThis() const noexcept {
+    WeakPtr<const T, Policy> WeakFromThis() const noexcept {
         return weak_this_;
     }
-    WeakPtr<T> weak_this_;
+    WeakPtr<T, Policy> weak_this_;
 };
\ No newline at end of file
@@ -0,0 +1,534 @@
+#pragma once
+
+#include "sw_fwd.h"
+
+#include <cerrno>
+#include <cstddef>  // std::nullptr_t
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Allocator living at the start of a shared memory segment. Everything in the segment is
+// addressed by offsets from the heap, so every process may map it at a different address.
+// Freed memory is recycled through per-size free lists, under a process-shared mutex.
+class ShmHeap {
+public:
+    static constexpr size_t kGranularity = 16;
+
+    ShmHeap(const ShmHeap&) = delete;
+    ShmHeap& operator=(const ShmHeap&) = delete;
+
+    // Throws std::bad_alloc when the segment is full.
+    void* Allocate(size_t size) {
+        if (size > size_) {
+            throw std::bad_alloc();
+        }
+        size_t size_class = GetClass(size);
+        size_t bytes = GetBytes(size_class);
+        Lock lock(mutex_);
+        uint64_t offset = free_[size_class];
+        if (offset != 0) {
+            free_[size_class] = *static_cast<uint64_t*>(FromOffset(offset));
+            return FromOffset(offset);
+        }
+        if (bytes > size_ - next_) {
+            throw std::bad_alloc();
+        }
+        offset = next_;
+        next_ += bytes;
+        return FromOffset(offset);
+    }
+
+    void Deallocate(void* ptr, size_t size) {
+        size_t size_class = GetClass(size);
+        Lock lock(mutex_);
+        *static_cast<uint64_t*>(ptr) = free_[size_class];
+        free_[size_class] = ToOffset(ptr);
+    }
+
+    uint64_t ToOffset(const void* ptr) const {
+        return reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(this);
+    }
+
+    void* FromOffset(uint64_t offset) const {
+        return reinterpret_cast<unsigned char*>(const_cast<ShmHeap*>(this)) + offset;
+    }
+
+    size_t GetSize() const {
+        return size_;
+    }
+
+private:
+    friend class SharedSegment;
+
+    static constexpr uint64_t kMagic = 0x706165486d6853ull;  // "ShmHeap"
+    // Exact classes for small sizes, powers of two above.
+    static constexpr size_t kExactClasses = 32;
+    static constexpr size_t kClasses = kExactClasses + 48;
+
+    // The mutex is robust, so a process dying inside a critical section doesn't deadlock the
+    // others. Every critical section moves the heap between consistent states with a single
+    // store, so the next owner only has to mark the mutex consistent; at worst the dead
+    // process' pending deallocation leaks.
+    struct Lock {
+        explicit Lock(pthread_mutex_t& mutex) : mutex(mutex) {
+            if (pthread_mutex_lock(&mutex) == EOWNERDEAD) {
+                pthread_mutex_consistent(&mutex);
+            }
+        }
+
+        ~Lock() {
+            pthread_mutex_unlock(&mutex);
+        }
+
+        pthread_mutex_t& mutex;
+    };
+
+    explicit ShmHeap(size_t size) : size_(size) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&mutex_, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    static size_t GetClass(size_t size) {
+        size_t granules = (size + kGranularity - 1) / kGranularity;
+        if (granules <= kExactClasses) {
+            return granules == 0 ? 0 : granules - 1;
+        }
+        size_t size_class = kExactClasses;
+        for (size_t capacity = kExactClasses * 2; capacity < granules; capacity *= 2) {
+            ++size_class;
+        }
+        return size_class;
+    }
+
+    static size_t GetBytes(size_t size_class) {
+        if (size_class < kExactClasses) {
+            return (size_class + 1) * kGranularity;
+        }
+        return (kExactClasses << (size_class - kExactClasses + 1)) * kGranularity;
+    }
+
+    static constexpr size_t HeaderSize() {
+        return (sizeof(ShmHeap) + kGranularity - 1) / kGranularity * kGranularity;
+    }
+
+    uint64_t magic_ = kMagic;
+    uint64_t size_;
+    pthread_mutex_t mutex_;
+    uint64_t next_ = HeaderSize();
+    uint64_t free_[kClasses] = {};
+};
+
+// This process' mapping of a shared memory segment (a memfd), holding a ShmHeap.
+// Processes forked afterwards inherit the mapping; unrelated ones can map the segment
+// from its file descriptor, e.g. passed over a Unix socket. Throws std::system_error.
+class SharedSegment {
+public:
+    static SharedSegment Create(size_t size) {
+        int fd = ::memfd_create("smart_pointers", MFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "memfd_create");
+        }
+        if (size < ShmHeap::HeaderSize()) {
+            size = ShmHeap::HeaderSize();
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            Fail(fd, "ftruncate");
+        }
+        void* memory = Map(fd, size);
+        return SharedSegment(fd, ::new (memory) ShmHeap(size));
+    }
+
+    // Maps the segment behind `fd`, which is duplicated.
+    static SharedSegment Open(int fd) {
+        fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "fcntl");
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            Fail(fd, "fstat");
+        }
+        auto heap = static_cast<ShmHeap*>(Map(fd, info.st_size));
+        if (static_cast<size_t>(info.st_size) < sizeof(ShmHeap) ||
+            heap->magic_ != ShmHeap::kMagic) {
+            ::munmap(heap, info.st_size);
+            errno = EINVAL;
+            Fail(fd, "not a shared segment");
+        }
+        return SharedSegment(fd, heap);
+    }
+
+    SharedSegment(SharedSegment&& other) noexcept
+        : fd_(std::exchange(other.fd_, -1)), heap_(std::exchange(other.heap_, nullptr)) {
+    }
+
+    SharedSegment& operator=(SharedSegment&& other) noexcept {
+        std::swap(fd_, other.fd_);
+        std::swap(heap_, other.heap_);
+        return *this;
+    }
+
+    // Objects are left alone: other processes may still use them.
+    ~SharedSegment() {
+        if (heap_) {
+            ::munmap(heap_, heap_->GetSize());
+            ::close(fd_);
+        }
+    }
+
+    ShmHeap& GetHeap() const {
+        return *heap_;
+    }
+
+    int GetFd() const {
+        return fd_;
+    }
+
+private:
+    SharedSegment(int fd, ShmHeap* heap) : fd_(fd), heap_(heap) {
+    }
+
+    static void* Map(int fd, size_t size) {
+        void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            Fail(fd, "mmap");
+        }
+        return memory;
+    }
+
+    [[noreturn]] static void Fail(int fd, const char* what) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    int fd_;
+    ShmHeap* heap_;
+};
+
+// Counts and object in one ShmHeap allocation, like MakeShared's block. Holds no pointers
+// and no manager: the heap is found from the block's own offset, and the handles know T.
+template <typename T>
+class ShmControlBlock {
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                  "counts have to be lock-free to work across processes");
+    static_assert(alignof(T) <= ShmHeap::kGranularity, "over-aligned types don't fit");
+
+public:
+    template <typename... Args>
+    static ShmControlBlock* New(ShmHeap& heap, Args&&... args) {
+        void* memory = heap.Allocate(sizeof(ShmControlBlock));
+        try {
+            return ::new (memory) ShmControlBlock(heap, std::forward<Args>(args)...);
+        } catch (...) {
+            heap.Deallocate(memory, sizeof(ShmControlBlock));
+            throw;
+        }
+    }
+
+    void Increment() {
+        counts_.Increment();
+    }
+
+    void IncrementWeak() {
+        counts_.IncrementWeak();
+    }
+
+    bool IncrementIfNotZero() {
+        return counts_.IncrementIfNotZero();
+    }
+
+    void Release() {
+        switch (counts_.Release()) {
+            case Released::kBlockDead:
+                DestroyObject();
+                Free();
+                break;
+            case Released::kObjectDead:
+                DestroyObject();
+                ReleaseWeak();
+                break;
+            case Released::kAlive:
+                break;
+        }
+    }
+
+    void ReleaseWeak() {
+        if (counts_.ReleaseWeak()) {
+            Free();
+        }
+    }
+
+    size_t GetReferenceCount() const {
+        return counts_.GetReferenceCount();
+    }
+
+    T* GetPointer() {
+        return reinterpret_cast<T*>(&storage_);
+    }
+
+    ShmHeap& GetHeap() const {
+        return *reinterpret_cast<ShmHeap*>(reinterpret_cast<uintptr_t>(this) - heap_offset_);
+    }
+
+private:
+    template <typename... Args>
+    ShmControlBlock(ShmHeap& heap, Args&&... args) : heap_offset_(heap.ToOffset(this)) {
+        ::new (static_cast<void*>(&storage_)) T(std::forward<Args>(args)...);
+    }
+
+    void DestroyObject() {
+        GetPointer()->~T();
+    }
+
+    void Free() {
+        ShmHeap& heap = GetHeap();
+        this->~ShmControlBlock();
+        heap.Deallocate(this, sizeof(ShmControlBlock));
+    }
+
+    RefCounts<MultiThreaded> counts_;
+    uint64_t heap_offset_;
+    std::aligned_storage_t<sizeof(T), alignof(T)> storage_;
+};
+
+// Offset of a block within its segment: what processes pass to each other. 0 is null.
+using ShmOffset = uint64_t;
+
+template <typename T>
+class ShmWeakPtr;
+
+// SharedPtr to an object living in a SharedSegment; the last release in any process
+// destroys it. T has to be usable from every process mapping the segment: no pointers
+// into private memory, and no virtual functions unless all of them are forks of one.
+//
+// Handles themselves are process-local. To hand a reference to another process, Share()
+// it and send the offset; the receiver takes it over with Adopt().
+template <typename T>
+class ShmSharedPtr {
+    template <typename Y>
+    friend class ShmWeakPtr;
+
+    template <typename Y, typename... Args>
+    friend ShmSharedPtr<Y> MakeShmShared(const SharedSegment& segment, Args&&... args);
+
+    using Block = ShmControlBlock<T>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    constexpr ShmSharedPtr() noexcept : block_(nullptr) {
+    }
+
+    constexpr ShmSharedPtr(std::nullptr_t) noexcept : ShmSharedPtr() {
+    }
+
+    ShmSharedPtr(const ShmSharedPtr& other) noexcept : block_(other.block_) {
+        AddRef();
+    }
+
+    ShmSharedPtr(ShmSharedPtr&& other) noexcept : block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    // Takes over a reference made by Share(), possibly in another process.
+    static ShmSharedPtr Adopt(const SharedSegment& segment, ShmOffset offset) noexcept {
+        ShmSharedPtr shared;
+        if (offset != 0) {
+            shared.block_ = static_cast<Block*>(segment.GetHeap().FromOffset(offset));
+        }
+        return shared;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+    ShmSharedPtr& operator=(const ShmSharedPtr& other) noexcept {
+        ShmSharedPtr(other).Swap(*this);
+        return *this;
+    }
+
+    ShmSharedPtr& operator=(ShmSharedPtr&& other) noexcept {
+        ShmSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~ShmSharedPtr() {
+        if (block_) {
+            block_->Release();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Reset() noexcept {
+        ShmSharedPtr().Swap(*this);
+    }
+
+    void Swap(ShmSharedPtr& other) noexcept {
+        std::swap(block_, other.block_);
+    }
+
+    // Take a new reference for Adopt() to pick up. It is leaked if nobody does.
+    ShmOffset Share() const noexcept {
+        if (!block_) {
+            return 0;
+        }
+        block_->Increment();
+        return block_->GetHeap().ToOffset(block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    T* Get() const noexcept {
+        return block_ ? block_->GetPointer() : nullptr;
+    }
+
+    T& operator*() const noexcept {
+        return *Get();
+    }
+
+    T* operator->() const noexcept {
+        return Get();
+    }
+
+    size_t UseCount() const noexcept {
+        if (!block_) {
+            return 0;
+        }
+        return block_->GetReferenceCount();
+    }
+
+    explicit operator bool() const noexcept {
+        return block_ != nullptr;
+    }
+
+private:
+    void AddRef() {
+        if (block_) {
+            block_->Increment();
+        }
+    }
+
+    Block* block_;
+};
+
+template <typename T>
+class ShmWeakPtr {
+    using Block = ShmControlBlock<T>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    constexpr ShmWeakPtr() noexcept : block_(nullptr) {
+    }
+
+    ShmWeakPtr(const ShmSharedPtr<T>& other) noexcept : block_(other.block_) {
+        AddRef();
+    }
+
+    ShmWeakPtr(const ShmWeakPtr& other) noexcept : block_(other.block_) {
+        AddRef();
+    }
+
+    ShmWeakPtr(ShmWeakPtr&& other) noexcept : block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    // Takes over a weak reference made by Share(), possibly in another process.
+    static ShmWeakPtr Adopt(const SharedSegment& segment, ShmOffset offset) noexcept {
+        ShmWeakPtr weak;
+        if (offset != 0) {
+            weak.block_ = static_cast<Block*>(segment.GetHeap().FromOffset(offset));
+        }
+        return weak;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+    ShmWeakPtr& operator=(const ShmWeakPtr& other) noexcept {
+        ShmWeakPtr(other).Swap(*this);
+        return *this;
+    }
+
+    ShmWeakPtr& operator=(ShmWeakPtr&& other) noexcept {
+        ShmWeakPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~ShmWeakPtr() {
+        if (block_) {
+            block_->ReleaseWeak();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Reset() noexcept {
+        ShmWeakPtr().Swap(*this);
+    }
+
+    void Swap(ShmWeakPtr& other) noexcept {
+        std::swap(block_, other.block_);
+    }
+
+    // Take a new weak reference for Adopt() to pick up. It is leaked if nobody does.
+    ShmOffset Share() const noexcept {
+        if (!block_) {
+            return 0;
+        }
+        block_->IncrementWeak();
+        return block_->GetHeap().ToOffset(block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    size_t UseCount() const noexcept {
+        if (!block_) {
+            return 0;
+        }
+        return block_->GetReferenceCount();
+    }
+
+    bool Expired() const noexcept {
+        return UseCount() == 0;
+    }
+
+    ShmSharedPtr<T> Lock() const noexcept {
+        ShmSharedPtr<T> shared;
+        if (block_ && block_->IncrementIfNotZero()) {
+            shared.block_ = block_;
+        }
+        return shared;
+    }
+
+private:
+    void AddRef() {
+        if (block_) {
+            block_->IncrementWeak();
+        }
+    }
+
+    Block* block_;
+};
+
+template <typename T, typename... Args>
+ShmSharedPtr<T> MakeShmShared(const SharedSegment& segment, Args&&... args) {
+    ShmSharedPtr<T> shared;
+    shared.block_ = ShmControlBlock<T>::New(segment.GetHeap(), std::forward<Args>(args)...);
+    return shared;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "atomic_shared.h"
+#include "intrusive.h"  // kCacheLineSize
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Read-mostly value published as immutable snapshots, e.g. the current configuration.
+//
+// Every reader thread caches the snapshot it saw last together with its version, and only
+// goes to the shared AtomicSharedPtr when the version changed: a steady-state Get() reads
+// one word that is written by publishers only, and touches no reference count.
+//
+// An old snapshot dies once every thread that cached it has read the cell again, or has
+// exited; an idle thread keeps its snapshot alive, even past the cell's destruction.
+// Get() must not be called from thread_local destructors.
+template <typename T>
+class SnapshotCell {
+public:
+    using Snapshot = SharedPtr<const T, MultiThreaded>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    SnapshotCell() : id_(AcquireId()) {
+    }
+
+    explicit SnapshotCell(Snapshot snapshot) : SnapshotCell() {
+        Publish(std::move(snapshot));
+    }
+
+    SnapshotCell(const SnapshotCell&) = delete;
+    SnapshotCell& operator=(const SnapshotCell&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~SnapshotCell() {
+        ReleaseId(id_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Publish(Snapshot snapshot) {
+        std::lock_guard<std::mutex> guard(publish_mutex_);
+        current_.Store(std::move(snapshot));
+        // Versions are unique among all cells of T, so a cache entry left behind by a dead
+        // cell never matches the one that reuses its id.
+        version_.store(next_version_.fetch_add(1, std::memory_order_relaxed) + 1,
+                       std::memory_order_release);
+    }
+
+    template <typename... Args>
+    void Emplace(Args&&... args) {
+        Publish(MakeShared<T, MultiThreaded>(std::forward<Args>(args)...));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    // The calling thread's cached snapshot, valid until its next Get() on this cell.
+    const Snapshot& Get() const {
+        CacheEntry& entry = GetCacheEntry();
+        uint64_t version = version_.load(std::memory_order_acquire);
+        if (entry.version != version) {
+            // A publisher racing with us may hand out a newer snapshot than `version`;
+            // then we reload it on the next call.
+            entry.snapshot = current_.Load();
+            entry.version = version;
+        }
+        return entry.snapshot;
+    }
+
+    // A reference of the caller's own, for keeping the snapshot past the next Get().
+    Snapshot Load() const {
+        return Get();
+    }
+
+private:
+    struct CacheEntry {
+        uint64_t version = 0;
+        Snapshot snapshot;
+    };
+
+    struct Ids {
+        std::mutex mutex;
+        std::vector<size_t> free;
+        size_t next = 0;
+    };
+
+    // Outlives all cells, so that cells with static storage may die in any order.
+    static Ids& GetIds() {
+        static Ids* ids = new Ids;
+        return *ids;
+    }
+
+    static size_t AcquireId() {
+        Ids& ids = GetIds();
+        std::lock_guard<std::mutex> guard(ids.mutex);
+        if (ids.free.empty()) {
+            return ids.next++;
+        }
+        size_t id = ids.free.back();
+        ids.free.pop_back();
+        return id;
+    }
+
+    static void ReleaseId(size_t id) {
+        Ids& ids = GetIds();
+        std::lock_guard<std::mutex> guard(ids.mutex);
+        ids.free.push_back(id);
+    }
+
+    // Entries are indexed by cell id; ids are recycled, so the table stays as small as
+    // the largest number of cells alive at once. A deque, because growing it must not move
+    // the snapshots earlier Get()s on other cells returned.
+    CacheEntry& GetCacheEntry() const {
+        thread_local std::deque<CacheEntry> cache;
+        if (id_ >= cache.size()) {
+            cache.resize(id_ + 1);
+        }
+        return cache[id_];
+    }
+
+    static inline std::atomic<uint64_t> next_version_{0};
+
+    const size_t id_;
+    AtomicSharedPtr<const T> current_;
+    std::mutex publish_mutex_;
+    // Read by every Get(), so kept away from the lines publishers and reloads write.
+    // The alignment also rounds the cell up to whole lines.
+    alignas(kCacheLineSize) std::atomic<uint64_t> version_{0};
+};
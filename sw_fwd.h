@@ -1,87 +1,720 @@
 #pragma once
 
+#include "compressed_pair.h"
+#include "instrument.h"
+#include "unique.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+#ifdef SMART_POINTERS_POOLED_BLOCKS
+#include "block_pool.h"
+#endif
 
 class BadWeakPtr : public std::exception {};
 
+// Reference counting policies.
+// SingleThreaded keeps plain counters: pointers sharing a block must stay on one thread.
+// MultiThreaded uses atomic counters, so copies and releases may happen on any thread.
+struct SingleThreaded {};
+struct MultiThreaded {};
+
+#ifdef SMART_POINTERS_SINGLE_THREADED
+using DefaultPolicy = SingleThreaded;
+#else
+using DefaultPolicy = MultiThreaded;
+#endif
+
+// Storage for the packed reference counts, mirroring the std::atomic interface.
+template <typename Policy>
+class CountWord;
+
+template <>
+class CountWord<SingleThreaded> {
+public:
+    explicit CountWord(uint64_t value) : value_(value) {
+    }
+
+    uint64_t Load(std::memory_order) const {
+        return value_;
+    }
+
+    uint64_t FetchAdd(uint64_t delta, std::memory_order) {
+        uint64_t old = value_;
+        value_ += delta;
+        return old;
+    }
+
+    uint64_t FetchSub(uint64_t delta, std::memory_order) {
+        uint64_t old = value_;
+        value_ -= delta;
+        return old;
+    }
+
+    bool CompareExchange(uint64_t& expected, uint64_t desired, std::memory_order,
+                         std::memory_order) {
+        if (value_ != expected) {
+            expected = value_;
+            return false;
+        }
+        value_ = desired;
+        return true;
+    }
+
+private:
+    uint64_t value_;
+};
+
+template <>
+class CountWord<MultiThreaded> {
+public:
+    explicit CountWord(uint64_t value) : value_(value) {
+    }
+
+    uint64_t Load(std::memory_order order) const {
+        return value_.load(order);
+    }
+
+    uint64_t FetchAdd(uint64_t delta, std::memory_order order) {
+        return value_.fetch_add(delta, order);
+    }
+
+    uint64_t FetchSub(uint64_t delta, std::memory_order order) {
+        return value_.fetch_sub(delta, order);
+    }
+
+    bool CompareExchange(uint64_t& expected, uint64_t desired, std::memory_order success,
+                         std::memory_order failure) {
+        return value_.compare_exchange_weak(expected, desired, success, failure);
+    }
+
+private:
+    std::atomic<uint64_t> value_;
+};
+
+// Reference count operations performed by the calling thread. Only maintained when
+// SMART_POINTERS_COUNT_OPS is defined, e.g. to check that moves don't touch the counts.
+struct RefCountOps {
+    size_t increments = 0;
+    size_t decrements = 0;
+    size_t weak_increments = 0;
+    size_t weak_decrements = 0;
+
+    size_t Total() const {
+        return increments + decrements + weak_increments + weak_decrements;
+    }
+};
+
+#ifdef SMART_POINTERS_COUNT_OPS
+inline constexpr bool kCountRefOps = true;
+#else
+inline constexpr bool kCountRefOps = false;
+#endif
+
+inline RefCountOps& ThreadRefCountOps() {
+    thread_local RefCountOps ops;
+    return ops;
+}
+
+// Allocator for the control blocks of SharedPtr(T*) and MakeShared.
+// Defining SMART_POINTERS_POOLED_BLOCKS takes them from BlockPool instead of the heap.
+#ifdef SMART_POINTERS_POOLED_BLOCKS
 template <typename T>
+using DefaultBlockAllocator = PoolAllocator<T>;
+#else
+template <typename T>
+using DefaultBlockAllocator = std::allocator<T>;
+#endif
+
+template <typename T, typename Policy = DefaultPolicy>
 class SharedPtr;
 
-template <typename T>
+template <typename T, typename Policy = DefaultPolicy>
 class WeakPtr;
 
-class ControlBlockBase {
+template <typename T, typename Policy = DefaultPolicy>
+class EnableSharedFromThis;
+
+template <typename T, typename Policy = DefaultPolicy>
+class ThinSharedPtr;
+
+template <typename T, typename Policy = DefaultPolicy>
+class CompressedSharedPtr;
+
+template <typename T, typename Policy = DefaultPolicy, typename... Args>
+CompressedSharedPtr<T, Policy> MakeCompressedShared(Args&&... args);
+
+class BatchReleaser;
+
+template <typename T>
+inline constexpr bool kIsUnboundedArray = std::is_array_v<T> && std::extent_v<T> == 0;
+
+template <typename T, typename Policy = DefaultPolicy, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, SharedPtr<T, Policy>> MakeShared(Args&&... args);
+
+template <typename T, typename Policy = DefaultPolicy>
+std::enable_if_t<kIsUnboundedArray<T>, SharedPtr<T, Policy>> MakeShared(size_t count);
+
+template <typename T, typename Policy = DefaultPolicy, typename Alloc, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, SharedPtr<T, Policy>> AllocateShared(const Alloc& alloc,
+                                                                           Args&&... args);
+
+template <typename T, typename Policy = DefaultPolicy, typename Alloc>
+std::enable_if_t<kIsUnboundedArray<T>, SharedPtr<T, Policy>> AllocateShared(const Alloc& alloc,
+                                                                            size_t count);
+
+// Selects default-initialization of the new object, leaving trivial types uninitialized.
+struct DefaultInit {};
+
+// Outcome of dropping a strong reference.
+enum class Released {
+    kAlive,       // Other strong references remain.
+    kObjectDead,  // The object has to be destroyed, weak references still need the block.
+    kBlockDead,   // Neither the object nor the block is referenced anymore.
+};
+
+// Strong and weak counts share one 64-bit word: the strong count lives in the low half,
+// the weak count in the high half, so every transition is a single atomic operation.
+//
+// A block is created on behalf of its first owner, so both counts start at one.
+// All strong references together hold a single weak reference, which is dropped
+// after the object is destroyed: this way the block outlives DeleteObject() even
+// if the last weak reference is released concurrently.
+template <typename Policy>
+class RefCounts {
 public:
     void Increment() {
-        ++reference_count_;
+        // A new reference is always made from an existing one, so no ordering is needed.
+        counts_.FetchAdd(kStrongOne, std::memory_order_relaxed);
+    }
+
+    void IncrementWeak() {
+        counts_.FetchAdd(kWeakOne, std::memory_order_relaxed);
+    }
+
+    // Take a strong reference unless the object is already dead.
+    bool IncrementIfNotZero() {
+        uint64_t counts = counts_.Load(std::memory_order_relaxed);
+        do {
+            if (Strong(counts) == 0) {
+                return false;
+            }
+        } while (!counts_.CompareExchange(counts, counts + kStrongOne, std::memory_order_acq_rel,
+                                          std::memory_order_relaxed));
+        return true;
     }
 
-    void Decrement() {
-        --reference_count_;
+    Released Release() {
+        // The sole owner with no weak references can't race with anybody,
+        // so the whole block dies without touching the counts.
+        if (counts_.Load(std::memory_order_acquire) == kStrongOne + kWeakOne) {
+            return Released::kBlockDead;
+        }
+        // The release half publishes our writes to the object,
+        // the acquire half lets the last owner see everybody else's before destroying it.
+        if (Strong(counts_.FetchSub(kStrongOne, std::memory_order_acq_rel)) == 1) {
+            return Released::kObjectDead;
+        }
+        return Released::kAlive;
+    }
+
+    // Returns true when the block is no longer referenced.
+    bool ReleaseWeak() {
+        return counts_.FetchSub(kWeakOne, std::memory_order_acq_rel) == kWeakOne;
+    }
+
+    size_t GetReferenceCount() const {
+        return Strong(counts_.Load(std::memory_order_relaxed));
+    }
+
+    size_t GetWeakCount() const {
+        uint64_t counts = counts_.Load(std::memory_order_relaxed);
+        return Weak(counts) - (Strong(counts) != 0);
+    }
+
+private:
+    static constexpr uint64_t kStrongOne = 1;
+    static constexpr uint64_t kWeakOne = uint64_t{1} << 32;
+
+    static size_t Strong(uint64_t counts) {
+        return counts & (kWeakOne - 1);
+    }
+
+    static size_t Weak(uint64_t counts) {
+        return counts >> 32;
+    }
+
+    CountWord<Policy> counts_{kStrongOne + kWeakOne};
+};
+
+// Requests a control block manager has to serve.
+enum class BlockOp {
+    kDeleteObject,
+    kDestroyBlock,
+    kDestroyAll,  // Both of the above, saving an indirect call on the last release.
+    kGetDeleter,  // Return the deleter if it has the given type, null otherwise.
+};
+
+// Blocks carry a single manager function instead of a vtable: one load and one
+// indirect call per request, and the concrete block type is free to inline both halves.
+//
+// With SMART_POINTERS_INSTRUMENT defined, a block also points to the TypeStats of its object.
+template <typename Policy>
+class ControlBlockBase : private TypeStatsSlot<> {
+    friend class RefCounts<Policy>;
+
+public:
+    using Manager = void* (*)(ControlBlockBase* block, BlockOp op, const std::type_info* type);
+
+    void Increment() {
+        if constexpr (kCountRefOps) {
+            ++ThreadRefCountOps().increments;
+        }
+        if constexpr (kInstrumentTypes) {
+            Record(&TypeStats::OnIncrement);
+        }
+        counts_.Increment();
     }
 
     void IncrementWeak() {
-        ++weak_count_;
+        if constexpr (kCountRefOps) {
+            ++ThreadRefCountOps().weak_increments;
+        }
+        if constexpr (kInstrumentTypes) {
+            Record(&TypeStats::OnWeakIncrement);
+        }
+        counts_.IncrementWeak();
+    }
+
+    // Take a strong reference unless the object is already dead.
+    bool IncrementIfNotZero() {
+        if constexpr (kCountRefOps) {
+            ++ThreadRefCountOps().increments;
+        }
+        bool taken = counts_.IncrementIfNotZero();
+        if constexpr (kInstrumentTypes) {
+            if (taken) {
+                Record(&TypeStats::OnIncrement);
+            }
+        }
+        return taken;
     }
 
-    void DecrementWeak() {
-        --weak_count_;
+    // Drop a strong reference, destroying the object when the last one dies.
+    void Release() {
+        if constexpr (kCountRefOps) {
+            ++ThreadRefCountOps().decrements;
+        }
+        if constexpr (kInstrumentTypes) {
+            Record(&TypeStats::OnDecrement);
+        }
+        switch (counts_.Release()) {
+            case Released::kBlockDead:
+                if constexpr (kInstrumentTypes) {
+                    Record(&TypeStats::OnDestroy);
+                }
+                manager_(this, BlockOp::kDestroyAll, nullptr);
+                break;
+            case Released::kObjectDead:
+                DisposeObject();
+                break;
+            case Released::kAlive:
+                break;
+        }
+    }
+
+    // Drop a weak reference, destroying the block when nothing refers to it.
+    void ReleaseWeak() {
+        if constexpr (kCountRefOps) {
+            ++ThreadRefCountOps().weak_decrements;
+        }
+        if constexpr (kInstrumentTypes) {
+            Record(&TypeStats::OnWeakDecrement);
+        }
+        if (counts_.ReleaseWeak()) {
+            // The strong references hold a weak one, so the object is long dead.
+            if constexpr (kInstrumentTypes) {
+                Record(&TypeStats::OnUnlinger);
+            }
+            DestroyBlock();
+        }
     }
 
     size_t GetReferenceCount() const {
-        return reference_count_;
+        return counts_.GetReferenceCount();
     }
 
     size_t GetWeakCount() const {
-        return weak_count_;
+        return counts_.GetWeakCount();
+    }
+
+    void DeleteObject() {
+        manager_(this, BlockOp::kDeleteObject, nullptr);
+    }
+
+    // Destroy the block and give its memory back to wherever it came from.
+    void DestroyBlock() {
+        manager_(this, BlockOp::kDestroyBlock, nullptr);
+    }
+
+    // Null unless the block was created with a deleter of this type.
+    void* GetDeleter(const std::type_info& type) {
+        return manager_(this, BlockOp::kGetDeleter, &type);
+    }
+
+    // The manager identifies the concrete block type.
+    bool IsManagedBy(Manager manager) const {
+        return manager_ == manager;
+    }
+
+protected:
+    explicit ControlBlockBase(Manager manager, TypeStats* stats = nullptr)
+        : TypeStatsSlot<>(stats), manager_(manager) {
     }
 
-    virtual void DeleteObject() = 0;
+    ~ControlBlockBase() = default;
 
-    virtual ~ControlBlockBase() = default;
+    // Called by the concrete block once its object is built.
+    void RecordCreate() {
+        if constexpr (kInstrumentTypes) {
+            Record(&TypeStats::OnCreate);
+        }
+    }
 
 private:
-    size_t reference_count_ = 0;
-    size_t weak_count_ = 0;
+    // Destroy the object after the last strong reference died, then drop the weak
+    // reference held on behalf of all of them.
+    void DisposeObject() {
+        if constexpr (kInstrumentTypes) {
+            Record(&TypeStats::OnDestroy);
+        }
+        DeleteObject();
+        if constexpr (kCountRefOps) {
+            ++ThreadRefCountOps().weak_decrements;
+        }
+        if (counts_.ReleaseWeak()) {
+            DestroyBlock();
+        } else if constexpr (kInstrumentTypes) {
+            Record(&TypeStats::OnLinger);
+        }
+    }
+
+    void Record(void (TypeStats::*event)()) {
+        if (TypeStats* stats = GetStats()) {
+            (stats->*event)();
+        }
+    }
+
+    RefCounts<Policy> counts_;
+    Manager manager_;
 };
 
-template <typename T>
-class ControlBlockPointer : public ControlBlockBase {
+// Allocates a block through an allocator rebound to its type,
+// destroying the half-built block if its constructor throws.
+template <typename Block, typename Alloc, typename... Args>
+Block* NewBlock(const Alloc& alloc, Args&&... args) {
+    using Traits = typename std::allocator_traits<Alloc>::template rebind_traits<Block>;
+    typename Traits::allocator_type block_alloc(alloc);
+    Block* block = Traits::allocate(block_alloc, 1);
+    try {
+        ::new (static_cast<void*>(block)) Block(alloc, std::forward<Args>(args)...);
+    } catch (...) {
+        Traits::deallocate(block_alloc, block, 1);
+        throw;
+    }
+    return block;
+}
+
+template <typename Block, typename Alloc>
+void DeleteBlock(Block* block, const Alloc& alloc) {
+    using Traits = typename std::allocator_traits<Alloc>::template rebind_traits<Block>;
+    typename Traits::allocator_type block_alloc(alloc);
+    block->~Block();
+    Traits::deallocate(block_alloc, block, 1);
+}
+
+// Owns an object allocated elsewhere and disposes of it with `Deleter`.
+// Empty deleters and allocators take no space.
+template <typename T, typename Policy, typename Deleter = DefaultDeleter<T>,
+          typename Alloc = DefaultBlockAllocator<std::remove_extent_t<T>>>
+class ControlBlockPointer : public ControlBlockBase<Policy>, private CompressedElement<Alloc, 0> {
+    using Element = std::remove_extent_t<T>;
+
 public:
-    ControlBlockPointer() : ptr_(nullptr) {
+    ControlBlockPointer(const Alloc& alloc, Element* ptr)
+        : ControlBlockBase<Policy>(&Manage, GetTypeStats<T>()),
+          CompressedElement<Alloc, 0>(alloc),
+          ptr_(ptr, Deleter()) {
+        this->RecordCreate();
+    }
+
+    template <typename D>
+    ControlBlockPointer(const Alloc& alloc, Element* ptr, D&& deleter)
+        : ControlBlockBase<Policy>(&Manage, GetTypeStats<T>()),
+          CompressedElement<Alloc, 0>(alloc),
+          ptr_(ptr, std::forward<D>(deleter)) {
+        this->RecordCreate();
+    }
+
+private:
+    static void* Manage(ControlBlockBase<Policy>* base, BlockOp op, const std::type_info* type) {
+        auto block = static_cast<ControlBlockPointer*>(base);
+        if (op == BlockOp::kGetDeleter) {
+            return *type == typeid(Deleter) ? &block->ptr_.GetSecond() : nullptr;
+        }
+        if (op != BlockOp::kDestroyBlock) {
+            block->ptr_.GetSecond()(block->ptr_.GetFirst());
+        }
+        if (op != BlockOp::kDeleteObject) {
+            DeleteBlock(block, Alloc(block->CompressedElement<Alloc, 0>::Get()));
+        }
+        return nullptr;
+    }
+
+    CompressedPair<Element*, Deleter> ptr_;
+};
+
+// Keeps the object next to the counts, constructing and destroying it through the allocator.
+template <typename T, typename Policy, typename Alloc = DefaultBlockAllocator<T>>
+class ControlBlockHolder : public ControlBlockBase<Policy>, private CompressedElement<Alloc, 0> {
+    using ObjectTraits =
+        typename std::allocator_traits<Alloc>::template rebind_traits<std::remove_cv_t<T>>;
+
+public:
+    template <typename... Args>
+    ControlBlockHolder(const Alloc& alloc, Args&&... args)
+        : ControlBlockBase<Policy>(&Manage, GetTypeStats<std::remove_cv_t<T>>()),
+          CompressedElement<Alloc, 0>(alloc) {
+        typename ObjectTraits::allocator_type object_alloc(alloc);
+        ObjectTraits::construct(object_alloc, GetObject(), std::forward<Args>(args)...);
+        this->RecordCreate();
+    }
+
+    ControlBlockHolder(const Alloc& alloc, DefaultInit)
+        : ControlBlockBase<Policy>(&Manage, GetTypeStats<std::remove_cv_t<T>>()),
+          CompressedElement<Alloc, 0>(alloc) {
+        ::new (static_cast<void*>(GetObject())) std::remove_cv_t<T>;
+        this->RecordCreate();
+    }
+
+    T* GetPointer() {
+        return GetObject();
+    }
+
+    // Returns null unless `block` is a ControlBlockHolder of this very type.
+    static ControlBlockHolder* Cast(ControlBlockBase<Policy>* block) {
+        return block && block->IsManagedBy(&Manage) ? static_cast<ControlBlockHolder*>(block)
+                                                     : nullptr;
+    }
+
+private:
+    static void* Manage(ControlBlockBase<Policy>* base, BlockOp op, const std::type_info*) {
+        auto block = static_cast<ControlBlockHolder*>(base);
+        if (op == BlockOp::kGetDeleter) {
+            return nullptr;
+        }
+        if (op != BlockOp::kDestroyBlock) {
+            typename ObjectTraits::allocator_type object_alloc(block->GetAllocator());
+            ObjectTraits::destroy(object_alloc, block->GetObject());
+        }
+        if (op != BlockOp::kDeleteObject) {
+            DeleteBlock(block, Alloc(block->GetAllocator()));
+        }
+        return nullptr;
+    }
+
+    std::remove_cv_t<T>* GetObject() {
+        return reinterpret_cast<std::remove_cv_t<T>*>(&storage_);
     }
 
-    ControlBlockPointer(T* ptr) : ptr_(ptr) {
+    Alloc& GetAllocator() {
+        return CompressedElement<Alloc, 0>::Get();
     }
 
-    void DeleteObject() override {
-        delete ptr_;
+    std::aligned_storage_t<sizeof(T), alignof(T)> storage_;
+};
+
+// Unit of allocation for blocks with trailing storage.
+template <size_t Alignment>
+struct alignas(Alignment) BlockChunk {
+    unsigned char bytes[Alignment];
+};
+
+// Keeps the elements of a T[] right after the counts, so that the block and the array
+// take a single allocation. Elements are built in order and destroyed in reverse.
+template <typename T, typename Policy,
+          typename Alloc = DefaultBlockAllocator<std::remove_extent_t<T>>>
+class ControlBlockArray : public ControlBlockBase<Policy>, private CompressedElement<Alloc, 0> {
+    using Element = std::remove_cv_t<std::remove_extent_t<T>>;
+    using ElementTraits = typename std::allocator_traits<Alloc>::template rebind_traits<Element>;
+
+    static_assert(!std::is_array_v<Element>, "multidimensional arrays are not supported");
+
+public:
+    // Pass DefaultInit{} to default-initialize the elements instead of value-initializing.
+    template <typename... Init>
+    static ControlBlockArray* New(const Alloc& alloc, size_t count, Init... init) {
+        using ChunkTraits = typename std::allocator_traits<Alloc>::template rebind_traits<Chunk>;
+        static_assert(alignof(ControlBlockArray) <= kAlignment);
+        typename ChunkTraits::allocator_type chunk_alloc(alloc);
+        Chunk* memory = ChunkTraits::allocate(chunk_alloc, ChunkCount(count));
+        try {
+            return ::new (static_cast<void*>(memory)) ControlBlockArray(alloc, count, init...);
+        } catch (...) {
+            ChunkTraits::deallocate(chunk_alloc, memory, ChunkCount(count));
+            throw;
+        }
     }
 
-    ~ControlBlockPointer() override = default;
+    std::remove_extent_t<T>* GetPointer() {
+        return GetElements();
+    }
 
 private:
-    T* ptr_ = nullptr;
+    static constexpr size_t kAlignment = alignof(std::max_align_t) > alignof(Element)
+                                             ? alignof(std::max_align_t)
+                                             : alignof(Element);
+    using Chunk = BlockChunk<kAlignment>;
+
+    template <typename... Init>
+    ControlBlockArray(const Alloc& alloc, size_t count, Init... init)
+        : ControlBlockBase<Policy>(&Manage, GetTypeStats<T>()),
+          CompressedElement<Alloc, 0>(alloc),
+          count_(count) {
+        size_t built = 0;
+        try {
+            for (; built < count; ++built) {
+                Construct(GetElements() + built, init...);
+            }
+        } catch (...) {
+            DestroyElements(built);
+            throw;
+        }
+        this->RecordCreate();
+    }
+
+    static void* Manage(ControlBlockBase<Policy>* base, BlockOp op, const std::type_info*) {
+        auto block = static_cast<ControlBlockArray*>(base);
+        if (op == BlockOp::kGetDeleter) {
+            return nullptr;
+        }
+        if (op != BlockOp::kDestroyBlock) {
+            block->DestroyElements(block->count_);
+        }
+        if (op != BlockOp::kDeleteObject) {
+            using ChunkTraits =
+                typename std::allocator_traits<Alloc>::template rebind_traits<Chunk>;
+            typename ChunkTraits::allocator_type chunk_alloc(block->GetAllocator());
+            size_t chunks = ChunkCount(block->count_);
+            block->~ControlBlockArray();
+            ChunkTraits::deallocate(chunk_alloc, reinterpret_cast<Chunk*>(block), chunks);
+        }
+        return nullptr;
+    }
+
+    static size_t ElementOffset() {
+        return (sizeof(ControlBlockArray) + alignof(Element) - 1) / alignof(Element) *
+               alignof(Element);
+    }
+
+    static size_t ChunkCount(size_t count) {
+        return (ElementOffset() + count * sizeof(Element) + sizeof(Chunk) - 1) / sizeof(Chunk);
+    }
+
+    void Construct(Element* element) {
+        typename ElementTraits::allocator_type element_alloc(GetAllocator());
+        ElementTraits::construct(element_alloc, element);
+    }
+
+    void Construct(Element* element, DefaultInit) {
+        ::new (static_cast<void*>(element)) Element;
+    }
+
+    void DestroyElements(size_t count) {
+        typename ElementTraits::allocator_type element_alloc(GetAllocator());
+        while (count != 0) {
+            ElementTraits::destroy(element_alloc, GetElements() + --count);
+        }
+    }
+
+    Element* GetElements() {
+        return reinterpret_cast<Element*>(reinterpret_cast<unsigned char*>(this) +
+                                          ElementOffset());
+    }
+
+    Alloc& GetAllocator() {
+        return CompressedElement<Alloc, 0>::Get();
+    }
+
+    size_t count_;
 };
 
-template <typename T>
-class ControlBlockHolder : public ControlBlockBase {
+// Keeps the object next to the counts like MakeShared does, but hands it to
+// Domain::Retire(object, reclaim) when the last strong reference dies, leaving the
+// domain to decide when it is destroyed. The block stays pinned by a weak reference
+// until then, since that's where the object lives.
+template <typename T, typename Policy, typename Domain>
+class ControlBlockDeferred : public ControlBlockBase<Policy> {
+    using Alloc = DefaultBlockAllocator<T>;
+
 public:
     template <typename... Args>
-    ControlBlockHolder(Args&&... args) {
-        ::new (GetPointer()) T(std::forward<Args>(args)...);
+    ControlBlockDeferred(const Alloc&, Args&&... args)
+        : ControlBlockBase<Policy>(&Manage, GetTypeStats<std::remove_cv_t<T>>()) {
+        ::new (static_cast<void*>(GetObject())) std::remove_cv_t<T>(std::forward<Args>(args)...);
+        this->RecordCreate();
     }
 
     T* GetPointer() {
-        return reinterpret_cast<T*>(&storage_);
+        return GetObject();
     }
 
-    void DeleteObject() override {
-        GetPointer()->~T();
+private:
+    static void* Manage(ControlBlockBase<Policy>* base, BlockOp op, const std::type_info*) {
+        auto block = static_cast<ControlBlockDeferred*>(base);
+        switch (op) {
+            case BlockOp::kDeleteObject:
+                block->IncrementWeak();
+                Domain::Retire(block, &ReclaimObject);
+                break;
+            case BlockOp::kDestroyBlock:
+                DeleteBlock(block, Alloc());
+                break;
+            case BlockOp::kDestroyAll:
+                Domain::Retire(block, &ReclaimAll);
+                break;
+            case BlockOp::kGetDeleter:
+                break;
+        }
+        return nullptr;
     }
 
-    ~ControlBlockHolder() override = default;
+    static void ReclaimObject(void* ptr) {
+        auto block = static_cast<ControlBlockDeferred*>(ptr);
+        block->DestroyObject();
+        block->ReleaseWeak();
+    }
+
+    static void ReclaimAll(void* ptr) {
+        auto block = static_cast<ControlBlockDeferred*>(ptr);
+        block->DestroyObject();
+        DeleteBlock(block, Alloc());
+    }
+
+    void DestroyObject() {
+        using Object = std::remove_cv_t<T>;
+        GetObject()->~Object();
+    }
+
+    std::remove_cv_t<T>* GetObject() {
+        return reinterpret_cast<std::remove_cv_t<T>*>(&storage_);
+    }
 
-private:
     std::aligned_storage_t<sizeof(T), alignof(T)> storage_;
-};
\ No newline at end of file
+};
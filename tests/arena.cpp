@@ -0,0 +1,93 @@
+// Arena allocation and ArenaPtr lifetimes: destructors run once when the pointer dies,
+// the memory stays with the arena until Reset().
+
+#include "../arena.h"
+#include "check.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace {
+
+int live = 0;
+
+struct Base {
+    Base() {
+        ++live;
+    }
+
+    virtual ~Base() {
+        --live;
+    }
+};
+
+struct Derived : Base {
+    explicit Derived(std::string name) : name(std::move(name)) {
+    }
+
+    std::string name;
+};
+
+static_assert(sizeof(ArenaPtr<Derived>) == sizeof(Derived*));
+
+void TestLifetime() {
+    Arena arena;
+    {
+        ArenaPtr<Derived> derived = MakeUniqueIn<Derived>(arena, "a name that does not fit in SSO");
+        CHECK(live == 1);
+        CHECK(derived->name == "a name that does not fit in SSO");
+        ArenaPtr<Base> base = std::move(derived);
+        CHECK(!derived && live == 1);
+        ArenaPtr<Base> other = MakeUniqueIn<Derived>(arena, "other");
+        CHECK(live == 2);
+        other.Reset();
+        CHECK(live == 1);
+    }
+    CHECK(live == 0);
+    ArenaPtr<int> trivial = MakeUniqueIn<int>(arena, 7);
+    CHECK(*trivial == 7);
+}
+
+void TestAllocation() {
+    Arena arena;
+    for (size_t alignment : {1, 8, 16, 64, 4096}) {
+        for (int i = 0; i < 10; ++i) {
+            void* ptr = arena.Allocate(24, alignment);
+            CHECK(reinterpret_cast<uintptr_t>(ptr) % alignment == 0);
+        }
+    }
+    // Larger than any chunk the arena would pick on its own.
+    auto big = static_cast<unsigned char*>(arena.Allocate(4 * Arena::kMaxChunkSize));
+    big[0] = big[4 * Arena::kMaxChunkSize - 1] = 1;
+
+    // Allocations never overlap.
+    auto a = arena.Create<uint64_t>(1);
+    auto b = arena.Create<uint64_t>(2);
+    CHECK(*a == 1 && *b == 2 && a != b);
+}
+
+// Reset() keeps the newest chunk and starts over at its beginning.
+void TestReset() {
+    Arena arena;
+    void* first = arena.Allocate(16);
+    arena.Reset();
+    CHECK(arena.Allocate(16) == first);
+
+    // Too big for the current chunk: this one starts a new chunk, which Reset() keeps.
+    void* newest = arena.Allocate(2 * Arena::kMinChunkSize);
+    arena.Reset();
+    CHECK(arena.Allocate(16) == newest);
+    arena.Reset();
+    arena.Reset();
+    CHECK(arena.Allocate(16) == newest);
+}
+
+}  // namespace
+
+int main() {
+    TestLifetime();
+    TestAllocation();
+    TestReset();
+    return 0;
+}
@@ -0,0 +1,150 @@
+// MakeShared<T[]>, MakeSharedForOverwrite and MakeUnique<T[]>: construction, destruction
+// order, constructors throwing partway, empty arrays and over-aligned elements.
+
+#include "../shared.h"
+#include "../unique.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Records construction and destruction by index; the constructor throws once
+// `throw_at` elements have been built.
+struct Tracked {
+    Tracked() {
+        if (built == throw_at) {
+            throw std::runtime_error("Tracked");
+        }
+        index = built++;
+    }
+
+    ~Tracked() {
+        destroyed.push_back(index);
+    }
+
+    static void Reset(int throw_after = -1) {
+        built = 0;
+        throw_at = throw_after;
+        destroyed.clear();
+    }
+
+    int index;
+
+    static inline int built = 0;
+    static inline int throw_at = -1;
+    static inline std::vector<int> destroyed;
+};
+
+const std::vector<int> kReversed = {4, 3, 2, 1, 0};
+const std::vector<int> kPartial = {2, 1, 0};
+
+template <typename Make>
+bool Throws(Make make) {
+    try {
+        make();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void TestDestructionOrder() {
+    Tracked::Reset();
+    auto shared = MakeShared<Tracked[], MultiThreaded>(5);
+    WeakPtr<Tracked[], MultiThreaded> weak = shared;
+    CHECK(shared[4].index == 4);
+    shared.Reset();
+    CHECK(Tracked::destroyed == kReversed);
+    CHECK(weak.Expired());
+
+    Tracked::Reset();
+    MakeSharedForOverwrite<Tracked[], SingleThreaded>(5);
+    CHECK(Tracked::destroyed == kReversed);
+
+    Tracked::Reset();
+    MakeUnique<Tracked[]>(5);
+    CHECK(Tracked::destroyed == kReversed);
+}
+
+// The elements built before the throwing one are destroyed in reverse, and nothing else.
+void TestThrowingConstructor() {
+    Tracked::Reset(3);
+    CHECK(Throws([] { MakeShared<Tracked[], MultiThreaded>(5); }));
+    CHECK(Tracked::destroyed == kPartial);
+
+    Tracked::Reset(3);
+    CHECK(Throws([] { MakeSharedForOverwrite<Tracked[], MultiThreaded>(5); }));
+    CHECK(Tracked::destroyed == kPartial);
+
+    Tracked::Reset(3);
+    CHECK(Throws([] { MakeUnique<Tracked[]>(5); }));
+    CHECK(Tracked::destroyed == kPartial);
+
+    Tracked::Reset(0);
+    CHECK(Throws([] { MakeShared<Tracked[], SingleThreaded>(1); }));
+    CHECK(Tracked::destroyed.empty());
+}
+
+void TestEmpty() {
+    Tracked::Reset(0);
+    auto shared = MakeShared<Tracked[], MultiThreaded>(0);
+    CHECK(shared.UseCount() == 1);
+    auto overwrite = MakeSharedForOverwrite<Tracked[], MultiThreaded>(0);
+    CHECK(overwrite.UseCount() == 1);
+    auto unique = MakeUnique<Tracked[]>(0);
+    shared.Reset();
+    overwrite.Reset();
+    unique.Reset();
+    CHECK(Tracked::destroyed.empty());
+}
+
+void TestValueInitialized() {
+    auto shared = MakeShared<int[], MultiThreaded>(100);
+    auto unique = MakeUnique<int[]>(100);
+    for (int i = 0; i < 100; ++i) {
+        CHECK(shared[i] == 0 && unique[i] == 0);
+    }
+}
+
+template <size_t Alignment>
+struct alignas(Alignment) Aligned {
+    unsigned char byte = 1;
+};
+
+template <size_t Alignment>
+void CheckAligned(const Aligned<Alignment>* elements, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        CHECK(reinterpret_cast<uintptr_t>(elements + i) % Alignment == 0);
+        CHECK(elements[i].byte == 1);
+    }
+}
+
+// The elements share one allocation with the counts, so the block has to honor them.
+template <size_t Alignment>
+void TestAlignment() {
+    for (size_t count : {1, 3, 17}) {
+        auto shared = MakeShared<Aligned<Alignment>[], MultiThreaded>(count);
+        CheckAligned(shared.Get(), count);
+        auto overwrite = MakeSharedForOverwrite<Aligned<Alignment>[], SingleThreaded>(count);
+        CheckAligned(overwrite.Get(), count);
+        auto unique = MakeUnique<Aligned<Alignment>[]>(count);
+        CheckAligned(unique.Get(), count);
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestDestructionOrder();
+    TestThrowingConstructor();
+    TestEmpty();
+    TestValueInitialized();
+    TestAlignment<32>();
+    TestAlignment<64>();
+    TestAlignment<256>();
+    return 0;
+}
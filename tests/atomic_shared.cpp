@@ -0,0 +1,137 @@
+// AtomicSharedPtr under concurrent loads and writes: readers always see a live value,
+// loans never leak, and every value is destroyed exactly once.
+
+#include "../atomic_shared.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<int> live{0};
+
+struct Value {
+    explicit Value(int id) : id(id) {
+        ++live;
+    }
+
+    ~Value() {
+        CHECK(magic == kMagic);
+        magic = 0;
+        --live;
+    }
+
+    static constexpr int kMagic = 0x5eed;
+    int magic = kMagic;
+    int id;
+};
+
+using Ptr = SharedPtr<Value, MultiThreaded>;
+
+Ptr Make(int id) {
+    return MakeShared<Value, MultiThreaded>(id);
+}
+
+void TestSingleThreaded() {
+    {
+        AtomicSharedPtr<Value> cell;
+        CHECK(!cell.Load());
+        cell.Store(Make(1));
+        CHECK(cell.Load()->id == 1);
+        Ptr old = cell.Exchange(Make(2));
+        CHECK(old->id == 1 && old.UseCount() == 1);
+
+        Ptr expected = old;
+        CHECK(!cell.CompareExchange(expected, Make(3)));
+        CHECK(expected->id == 2);
+        CHECK(cell.CompareExchange(expected, Make(4)));
+        CHECK(cell.Load()->id == 4);
+        // The cell's reference plus expected's.
+        CHECK(expected.UseCount() == 1);
+        CHECK(cell.Load().UseCount() == 2);
+        cell.Store(nullptr);
+        CHECK(!cell.Load());
+        cell.Store(Make(5));
+    }
+    CHECK(live == 0);
+}
+
+// Each loan is repaid, so far more than 2^16 loads in a row, with their results kept,
+// leave the slot word's loan bits at zero and the counts exact.
+void TestManyLoads() {
+    constexpr size_t kLoads = (size_t{1} << 16) + 1000;
+    {
+        AtomicSharedPtr<Value> cell(Make(1));
+        std::vector<Ptr> loaded;
+        loaded.reserve(kLoads);
+        for (size_t i = 0; i < kLoads; ++i) {
+            loaded.push_back(cell.Load());
+        }
+        CHECK(loaded.back().UseCount() == kLoads + 1);
+        Ptr old = cell.Exchange(Make(2));
+        CHECK(old.UseCount() == kLoads + 1);
+        loaded.clear();
+        CHECK(old.UseCount() == 1);
+    }
+    CHECK(live == 0);
+}
+
+// Readers race writers using all three write operations; the total number of loads
+// across threads runs far past 2^16.
+void TestConcurrent() {
+    constexpr int kReaders = 4;
+    constexpr int kWriters = 3;
+    constexpr int kIterations = 40000;
+    {
+        AtomicSharedPtr<Value> cell(Make(0));
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kReaders; ++i) {
+            threads.emplace_back([&] {
+                while (!stop.load(std::memory_order_relaxed)) {
+                    Ptr value = cell.Load();
+                    CHECK(!value || value->magic == Value::kMagic);
+                }
+            });
+        }
+        for (int i = 0; i < kWriters; ++i) {
+            threads.emplace_back([&, i] {
+                for (int j = 0; j < kIterations; ++j) {
+                    switch ((i + j) % 3) {
+                        case 0:
+                            cell.Store(Make(j));
+                            break;
+                        case 1:
+                            cell.Exchange(j % 10 == 0 ? Ptr() : Make(j));
+                            break;
+                        default: {
+                            Ptr expected = cell.Load();
+                            cell.CompareExchange(expected, Make(j));
+                            break;
+                        }
+                    }
+                }
+            });
+        }
+        for (int i = kReaders; i < kReaders + kWriters; ++i) {
+            threads[i].join();
+        }
+        stop = true;
+        for (int i = 0; i < kReaders; ++i) {
+            threads[i].join();
+        }
+        CHECK(live <= 1);
+    }
+    CHECK(live == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestSingleThreaded();
+    TestManyLoads();
+    TestConcurrent();
+    return 0;
+}
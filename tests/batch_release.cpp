@@ -0,0 +1,83 @@
+// ReleaseAll() empties every pointer and destroys each object exactly once, including
+// objects referenced several times within one batch.
+
+#include "../batch_release.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <vector>
+
+namespace {
+
+int live = 0;
+
+struct Counted {
+    Counted() {
+        ++live;
+    }
+
+    ~Counted() {
+        --live;
+    }
+};
+
+struct Node : SimpleRefCounted<Node> {
+    Node() {
+        ++live;
+    }
+
+    ~Node() {
+        --live;
+    }
+};
+
+template <typename Policy>
+void TestShared() {
+    std::vector<SharedPtr<Counted, Policy>> pointers;
+    for (int i = 0; i < 100; ++i) {
+        pointers.push_back(MakeShared<Counted, Policy>());
+        // Duplicates next to each other and a batch apart.
+        if (i % 3 == 0) {
+            pointers.push_back(pointers.back());
+        }
+        if (i % 7 == 0 && i >= 20) {
+            pointers.push_back(pointers[i - 20]);
+        }
+    }
+    pointers.emplace_back();
+    SharedPtr<Counted, Policy> kept = pointers[5];
+    WeakPtr<Counted, Policy> weak = pointers[6];
+    CHECK(live == 100);
+    ReleaseAll(pointers);
+    for (const auto& ptr : pointers) {
+        CHECK(!ptr);
+    }
+    CHECK(live == 1);
+    CHECK(kept.UseCount() == 1);
+    CHECK(weak.Expired());
+    kept.Reset();
+    CHECK(live == 0);
+}
+
+void TestIntrusive() {
+    std::vector<IntrusivePtr<Node>> pointers;
+    for (int i = 0; i < 50; ++i) {
+        pointers.push_back(MakeIntrusive<Node>());
+        pointers.push_back(pointers.back());
+    }
+    CHECK(live == 50);
+    ReleaseAll(pointers.begin(), pointers.end());
+    for (const auto& ptr : pointers) {
+        CHECK(!ptr);
+    }
+    CHECK(live == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestShared<SingleThreaded>();
+    TestShared<MultiThreaded>();
+    TestIntrusive();
+    return 0;
+}
@@ -0,0 +1,171 @@
+// Biased counting across threads: releases on foreign threads are handed off to the owner,
+// and blocks outliving their owner thread are settled by whoever releases them last.
+
+#include "../biased.h"
+#include "../shared.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<int> live{0};
+std::atomic<int> destroyed{0};
+
+struct Counted {
+    Counted() {
+        ++live;
+    }
+
+    ~Counted() {
+        --live;
+        ++destroyed;
+    }
+};
+
+using Ptr = SharedPtr<Counted, Biased>;
+using Weak = WeakPtr<Counted, Biased>;
+
+void TestOwnerOnly() {
+    destroyed = 0;
+    Ptr ptr = MakeShared<Counted, Biased>();
+    Ptr copy = ptr;
+    Weak weak = ptr;
+    CHECK(ptr.UseCount() == 2);
+    ptr.Reset();
+    CHECK(live == 1);
+    CHECK(weak.Lock().UseCount() == 2);
+    copy.Reset();
+    CHECK(live == 0 && destroyed == 1);
+    CHECK(weak.Expired());
+}
+
+// The foreign thread drops the last reference the owner made: it hands the block off and
+// the owner merges it on its next release or collection.
+void TestForeignReleaseHandsOff() {
+    destroyed = 0;
+    Ptr ptr = MakeShared<Counted, Biased>();
+    Ptr copy = ptr;
+    Weak weak = ptr;
+    std::thread([moved = std::move(copy)]() mutable { moved.Reset(); }).join();
+    CHECK(live == 1);
+    CHECK(ptr.UseCount() == 1);
+    ptr.Reset();
+    CHECK(live == 0 && destroyed == 1);
+    CHECK(weak.Expired());
+
+    // The owner only collects, without releasing anything afterwards.
+    Ptr owned = MakeShared<Counted, Biased>();
+    std::thread([moved = std::move(owned)]() mutable { moved.Reset(); }).join();
+    CHECK(live == 1);
+    BiasedOwner::CollectHandOffs();
+    CHECK(live == 0 && destroyed == 2);
+}
+
+// References made and dropped entirely on foreign threads.
+void TestForeignCopies() {
+    destroyed = 0;
+    Ptr ptr = MakeShared<Counted, Biased>();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&ptr] {
+            for (int j = 0; j < 1000; ++j) {
+                Ptr copy = ptr;
+                Weak weak = copy;
+                CHECK(weak.Lock());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(ptr.UseCount() == 1);
+    ptr.Reset();
+    BiasedOwner::CollectHandOffs();
+    CHECK(live == 0 && destroyed == 1);
+}
+
+// The owner thread exits with its blocks still referenced elsewhere; the foreign threads
+// merge the counts themselves.
+void TestOwnerExit() {
+    destroyed = 0;
+    std::vector<Ptr> pointers;
+    std::vector<Weak> weaks;
+    std::thread([&] {
+        for (int i = 0; i < 100; ++i) {
+            Ptr ptr = MakeShared<Counted, Biased>();
+            weaks.push_back(ptr);
+            pointers.push_back(ptr);
+            // Leave some blocks with an unsettled owner share and some fully moved out.
+            if (i % 2 == 0) {
+                pointers.push_back(std::move(ptr));
+            }
+        }
+    }).join();
+    CHECK(live == 100);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < pointers.size(); i += 2) {
+                Ptr copy = pointers[i];
+                pointers[i].Reset();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(live == 0 && destroyed == 100);
+    for (const Weak& weak : weaks) {
+        CHECK(weak.Expired());
+        CHECK(!weak.Lock());
+    }
+}
+
+// Foreign threads drop their copies while the owner drops its own, then collects.
+void TestStress() {
+    destroyed = 0;
+    constexpr int kObjects = 200;
+    std::vector<Ptr> pointers;
+    for (int i = 0; i < kObjects; ++i) {
+        pointers.push_back(MakeShared<Counted, Biased>());
+    }
+    std::vector<std::vector<Ptr>> given(4);
+    for (int i = 0; i < kObjects; ++i) {
+        for (auto& list : given) {
+            list.push_back(pointers[i]);
+        }
+    }
+    std::vector<std::thread> threads;
+    for (auto& list : given) {
+        threads.emplace_back([&list] {
+            std::vector<Ptr> copies(list.begin(), list.end());
+            list.clear();
+            for (Ptr& copy : copies) {
+                Weak weak = copy;
+                copy.Reset();
+                weak.Lock();
+            }
+        });
+    }
+    pointers.clear();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    BiasedOwner::CollectHandOffs();
+    CHECK(live == 0 && destroyed == kObjects);
+}
+
+}  // namespace
+
+int main() {
+    TestOwnerOnly();
+    TestForeignReleaseHandsOff();
+    TestForeignCopies();
+    TestOwnerExit();
+    TestStress();
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Built with SMART_POINTERS_POOLED_BLOCKS: control blocks come from BlockPool, blocks freed
+// on other threads find their way back through the depot, and AllocateShared frees with
+// an allocator equal to the one that allocated.
+
+#include "../shared.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+static_assert(std::is_same_v<DefaultBlockAllocator<int>, PoolAllocator<int>>,
+              "this test needs SMART_POINTERS_POOLED_BLOCKS");
+
+namespace {
+
+void TestPooledBlocks() {
+    auto first = MakeShared<std::string, MultiThreaded>("pooled");
+    // MakeShared objects live inside their block, so equal addresses mean equal blocks.
+    const void* block = first.Get();
+    WeakPtr<std::string, MultiThreaded> weak = first;
+    first.Reset();
+    CHECK(weak.Expired());
+    weak.Reset();
+    // The thread's free list is LIFO: the same block comes back.
+    auto second = MakeShared<std::string, MultiThreaded>("again");
+    CHECK(second.Get() == block);
+
+    SharedPtr<int, MultiThreaded> raw(new int(1));
+    CHECK(*raw == 1 && raw.UseCount() == 1);
+}
+
+// A thread frees blocks another one allocated and exits; its cache goes back to the depot,
+// where the next thread to refill picks the same blocks up.
+void TestCrossThreadFree() {
+    constexpr size_t kCount = 4 * BlockPool::kBatchSize;
+    std::vector<SharedPtr<int, MultiThreaded>> pointers;
+    std::set<const void*> blocks;
+    std::thread([&] {
+        for (size_t i = 0; i < kCount; ++i) {
+            pointers.push_back(MakeShared<int, MultiThreaded>(static_cast<int>(i)));
+            blocks.insert(pointers.back().Get());
+        }
+    }).join();
+    std::thread([&] { pointers.clear(); }).join();
+
+    std::thread([&] {
+        auto reused = MakeShared<int, MultiThreaded>(0);
+        CHECK(blocks.count(reused.Get()) == 1);
+    }).join();
+}
+
+// Allocators are stateful and unequal across ids: every deallocation must come from a
+// copy of the allocator that made the allocation.
+struct Heap {
+    std::map<void*, int> owners;
+    size_t allocations = 0;
+};
+
+template <typename T>
+struct TrackingAllocator {
+    using value_type = T;
+
+    TrackingAllocator(Heap* heap, int id) : heap(heap), id(id) {
+    }
+
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U>& other) : heap(other.heap), id(other.id) {
+    }
+
+    T* allocate(size_t count) {
+        T* ptr = std::allocator<T>().allocate(count);
+        heap->owners[ptr] = id;
+        ++heap->allocations;
+        return ptr;
+    }
+
+    void deallocate(T* ptr, size_t count) {
+        auto it = heap->owners.find(ptr);
+        CHECK(it != heap->owners.end());
+        CHECK(it->second == id);
+        heap->owners.erase(it);
+        std::allocator<T>().deallocate(ptr, count);
+    }
+
+    template <typename U>
+    bool operator==(const TrackingAllocator<U>& other) const {
+        return heap == other.heap && id == other.id;
+    }
+
+    template <typename U>
+    bool operator!=(const TrackingAllocator<U>& other) const {
+        return !(*this == other);
+    }
+
+    Heap* heap;
+    int id;
+};
+
+void TestStatefulAllocator() {
+    Heap heap;
+    {
+        auto a = AllocateShared<std::string, MultiThreaded>(TrackingAllocator<char>(&heap, 1),
+                                                            "a string that does not fit in SSO");
+        auto b = AllocateShared<int, SingleThreaded>(TrackingAllocator<int>(&heap, 2), 2);
+        auto c = AllocateShared<int[], MultiThreaded>(TrackingAllocator<int>(&heap, 3), 10);
+        WeakPtr<std::string, MultiThreaded> weak = a;
+        CHECK(heap.allocations == 3 && heap.owners.size() == 3);
+        CHECK(*a == "a string that does not fit in SSO" && *b == 2 && c[9] == 0);
+        a.Reset();
+        // The weak reference keeps the block.
+        CHECK(heap.owners.size() == 3);
+        CHECK(weak.Expired());
+    }
+    CHECK(heap.owners.empty());
+}
+
+}  // namespace
+
+int main() {
+    TestPooledBlocks();
+    TestCrossThreadFree();
+    TestStatefulAllocator();
+    return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Aborts with the failing expression; the tests are plain executables run by ctest.
+#define CHECK(expression)                                                                    \
+    do {                                                                                     \
+        if (!(expression)) {                                                                 \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expression); \
+            std::abort();                                                                    \
+        }                                                                                    \
+    } while (false)
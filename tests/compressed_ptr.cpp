@@ -0,0 +1,87 @@
+// Allocates across CompressedHeap segment boundaries and checks every object survives.
+
+#include "../compressed_ptr.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// One granule per object: a segment holds kSegmentSize / kGranularity - 1 of them after
+// its header, so this crosses into a third segment.
+void TestSegmentBoundary() {
+    constexpr size_t kPerSegment = CompressedHeap::kSegmentSize / CompressedHeap::kGranularity;
+    constexpr size_t kCount = 2 * kPerSegment + 16;
+    std::vector<CompressedUniquePtr<uint64_t>> pointers;
+    pointers.reserve(kCount);
+    for (size_t i = 0; i < kCount; ++i) {
+        pointers.push_back(MakeCompressedUnique<uint64_t>(i));
+    }
+    for (size_t i = 0; i < kCount; ++i) {
+        CHECK(*pointers[i] == i);
+        CHECK(CompressedHeap::Encode(pointers[i].Get()) != 0);
+    }
+}
+
+// Objects of mixed sizes near the end of a segment.
+void TestMixedSizesAcrossSegments() {
+    struct Big {
+        uint64_t words[64];
+    };
+    std::vector<CompressedUniquePtr<Big>> bigs;
+    std::vector<CompressedUniquePtr<uint64_t>> smalls;
+    constexpr size_t kCount = CompressedHeap::kSegmentSize / sizeof(Big) + 64;
+    for (size_t i = 0; i < kCount; ++i) {
+        bigs.push_back(MakeCompressedUnique<Big>());
+        bigs.back()->words[0] = i;
+        bigs.back()->words[63] = i;
+        smalls.push_back(MakeCompressedUnique<uint64_t>(i));
+    }
+    for (size_t i = 0; i < kCount; ++i) {
+        CHECK(bigs[i]->words[0] == i && bigs[i]->words[63] == i);
+        CHECK(*smalls[i] == i);
+    }
+}
+
+void TestShared() {
+    auto shared = MakeCompressedShared<int, MultiThreaded>(42);
+    static_assert(sizeof(shared) == 4);
+    CHECK(*shared == 42);
+    auto copy = shared;
+    CHECK(shared.UseCount() == 2);
+    SharedPtr<int, MultiThreaded> plain = copy;
+    CHECK(shared.UseCount() == 3);
+    copy.Reset();
+    CHECK(plain.UseCount() == 2);
+}
+
+struct Shared : EnableSharedFromThis<Shared, MultiThreaded> {
+    int value = 7;
+};
+
+// An empty handle converts to an empty SharedPtr without touching the object hook.
+void TestEmptyConversions() {
+    CompressedSharedPtr<Shared, MultiThreaded> empty;
+    SharedPtr<Shared, MultiThreaded> copied = empty;
+    CHECK(!copied && copied.UseCount() == 0);
+    SharedPtr<Shared, MultiThreaded> moved = std::move(empty);
+    CHECK(!moved);
+
+    auto compressed = MakeCompressedShared<Shared, MultiThreaded>();
+    CHECK(compressed->SharedFromThis().Get() == compressed.Get());
+    SharedPtr<Shared, MultiThreaded> taken = std::move(compressed);
+    CHECK(!compressed && taken->value == 7 && taken.UseCount() == 1);
+}
+
+}  // namespace
+
+int main() {
+    TestSegmentBoundary();
+    TestMixedSizesAcrossSegments();
+    TestShared();
+    TestEmptyConversions();
+    return 0;
+}
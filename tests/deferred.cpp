@@ -0,0 +1,143 @@
+// DestructionQueue: deferred objects survive until a drain, the reclaimer drains on its own
+// and on shutdown, and ControlBlockDeferred goes through its domain's Retire().
+
+#include "../deferred.h"
+#include "../intrusive.h"
+#include "../unique.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<int> live{0};
+
+struct Counted {
+    Counted() {
+        ++live;
+    }
+
+    ~Counted() {
+        --live;
+    }
+};
+
+struct Node : AtomicRefCounted<Node, DeferredDelete>, Counted {};
+
+void TestCollect() {
+    DestructionQueue::Stats before = DestructionQueue::GetStats();
+    auto shared = MakeDeferredShared<Counted, MultiThreaded>();
+    WeakPtr<Counted, MultiThreaded> weak = shared;
+    UniquePtr<Counted, DeferredDeleter<Counted>> unique(new Counted);
+    UniquePtr<Counted[], DeferredDeleter<Counted[]>> array(new Counted[3]);
+    IntrusivePtr<Node> node = MakeIntrusive<Node>();
+    CHECK(live == 6);
+
+    shared.Reset();
+    unique.Reset();
+    array.Reset();
+    node.Reset();
+    CHECK(weak.Expired());
+    CHECK(live == 6);
+    CHECK(DestructionQueue::Depth() == 4);
+
+    CHECK(DestructionQueue::Collect() == 4);
+    CHECK(live == 0);
+    DestructionQueue::Stats after = DestructionQueue::GetStats();
+    CHECK(after.depth == 0);
+    CHECK(after.queued - before.queued == 4);
+    CHECK(after.destroyed - before.destroyed == 4);
+    CHECK(after.peak_depth >= 4);
+}
+
+// The period is far longer than the test: only shutdown can have drained the queue.
+void TestReclaimerDrainsOnShutdown() {
+    DestructionQueue::StartReclaimer(std::chrono::hours(1));
+    std::vector<SharedPtr<Counted, MultiThreaded>> pointers;
+    for (int i = 0; i < 10; ++i) {
+        pointers.push_back(MakeDeferredShared<Counted, MultiThreaded>());
+    }
+    pointers.clear();
+    DestructionQueue::StopReclaimer();
+    CHECK(DestructionQueue::Depth() == 0);
+    CHECK(live == 0);
+}
+
+// Reaching kWakeDepth wakes the reclaimer before its period is over.
+void TestReclaimerWakesUp() {
+    DestructionQueue::StartReclaimer(std::chrono::hours(1));
+    for (size_t i = 0; i < DestructionQueue::kWakeDepth; ++i) {
+        MakeDeferredShared<Counted, MultiThreaded>();
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (live != 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(live == 0);
+    DestructionQueue::StopReclaimer();
+}
+
+// A domain that only records what it is handed.
+struct RecordingDomain {
+    using Reclaim = void (*)(void* object);
+
+    struct Entry {
+        void* object;
+        Reclaim reclaim;
+    };
+
+    static void Retire(void* object, Reclaim reclaim) {
+        retired.push_back({object, reclaim});
+    }
+
+    static void ReclaimAll() {
+        std::vector<Entry> batch;
+        batch.swap(retired);
+        for (const Entry& entry : batch) {
+            entry.reclaim(entry.object);
+        }
+    }
+
+    static inline std::vector<Entry> retired;
+};
+
+template <typename T, typename Policy>
+SharedPtr<T, Policy> MakeRecorded() {
+    auto block = NewBlock<ControlBlockDeferred<T, Policy, RecordingDomain>>(
+        DefaultBlockAllocator<T>());
+    return SharedPtr<T, Policy>(AdoptBlock(), block->GetPointer(), block);
+}
+
+void TestControlBlockDeferred() {
+    // With a weak reference: the object is retired, the block waits for the weak one.
+    auto ptr = MakeRecorded<Counted, MultiThreaded>();
+    WeakPtr<Counted, MultiThreaded> weak = ptr;
+    ptr.Reset();
+    CHECK(RecordingDomain::retired.size() == 1);
+    CHECK(weak.Expired() && !weak.Lock());
+    CHECK(live == 1);
+    RecordingDomain::ReclaimAll();
+    CHECK(live == 0);
+    weak.Reset();
+
+    // Without one: object and block are retired together.
+    MakeRecorded<Counted, SingleThreaded>();
+    CHECK(RecordingDomain::retired.size() == 1);
+    CHECK(live == 1);
+    RecordingDomain::ReclaimAll();
+    CHECK(live == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestCollect();
+    TestReclaimerDrainsOnShutdown();
+    TestReclaimerWakesUp();
+    TestControlBlockDeferred();
+    return 0;
+}
@@ -0,0 +1,231 @@
+// SharedPtr with custom deleters, allocators and adopted UniquePtrs: deleters run exactly
+// once, also when the block can't be allocated, and empty ones take no space.
+
+#include "../shared.h"
+#include "../unique.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace {
+
+// Set to make the next operator new fail.
+bool fail_next_allocation = false;
+
+}  // namespace
+
+void* operator new(size_t size) {
+    if (fail_next_allocation) {
+        fail_next_allocation = false;
+        throw std::bad_alloc();
+    }
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+int live = 0;
+
+struct Counted {
+    Counted() {
+        ++live;
+    }
+
+    ~Counted() {
+        --live;
+    }
+};
+
+struct Shared : EnableSharedFromThis<Shared, MultiThreaded>, Counted {};
+
+// Counts its calls through a shared counter, so copies of it count together.
+struct CountingDeleter {
+    void operator()(Counted* ptr) {
+        ++*calls;
+        delete ptr;
+    }
+
+    int* calls;
+};
+
+struct EmptyDeleter {
+    void operator()(Counted* ptr) {
+        delete ptr;
+    }
+};
+
+template <typename T>
+struct ThrowingAllocator {
+    using value_type = T;
+
+    ThrowingAllocator() = default;
+
+    template <typename U>
+    ThrowingAllocator(const ThrowingAllocator<U>&) {
+    }
+
+    T* allocate(size_t) {
+        throw std::bad_alloc();
+    }
+
+    void deallocate(T*, size_t) {
+        CHECK(false);
+    }
+
+    template <typename U>
+    bool operator==(const ThrowingAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const ThrowingAllocator<U>&) const {
+        return false;
+    }
+};
+
+template <typename Make>
+bool ThrowsBadAlloc(Make make) {
+    try {
+        make();
+    } catch (const std::bad_alloc&) {
+        return true;
+    }
+    return false;
+}
+
+// Empty deleters and allocators are compressed away.
+using PlainBlock = ControlBlockPointer<Counted, MultiThreaded>;
+static_assert(sizeof(ControlBlockPointer<Counted, MultiThreaded, EmptyDeleter>) ==
+              sizeof(PlainBlock));
+static_assert(sizeof(PlainBlock) == sizeof(ControlBlockBase<MultiThreaded>) + sizeof(Counted*));
+static_assert(sizeof(ControlBlockPointer<Counted, MultiThreaded, CountingDeleter>) ==
+              sizeof(PlainBlock) + sizeof(int*));
+
+void TestCalledOnce() {
+    int calls = 0;
+    {
+        SharedPtr<Counted, MultiThreaded> ptr(new Counted, CountingDeleter{&calls});
+        WeakPtr<Counted, MultiThreaded> weak = ptr;
+        SharedPtr<Counted, MultiThreaded> copy = ptr;
+        ptr.Reset();
+        CHECK(calls == 0);
+        copy.Reset();
+        CHECK(calls == 1 && live == 0);
+        CHECK(weak.Expired());
+    }
+    CHECK(calls == 1);
+
+    calls = 0;
+    SharedPtr<Counted, SingleThreaded>(new Counted, CountingDeleter{&calls},
+                                       std::allocator<char>());
+    CHECK(calls == 1 && live == 0);
+}
+
+void TestAllocationFailure() {
+    int calls = 0;
+    CHECK(ThrowsBadAlloc([&] {
+        SharedPtr<Counted, MultiThreaded>(new Counted, CountingDeleter{&calls},
+                                          ThrowingAllocator<char>());
+    }));
+    CHECK(calls == 1 && live == 0);
+
+    calls = 0;
+    CHECK(ThrowsBadAlloc([&] {
+        Counted* ptr = new Counted;
+        fail_next_allocation = true;
+        SharedPtr<Counted, MultiThreaded>(ptr, CountingDeleter{&calls});
+    }));
+    CHECK(calls == 1 && live == 0);
+
+    // Plain pointers are deleted as well.
+    CHECK(ThrowsBadAlloc([] {
+        Counted* ptr = new Counted;
+        fail_next_allocation = true;
+        SharedPtr<Counted, MultiThreaded> shared(ptr);
+    }));
+    CHECK(live == 0);
+    CHECK(ThrowsBadAlloc([] {
+        Shared* ptr = new Shared;
+        fail_next_allocation = true;
+        SharedPtr<Counted, MultiThreaded> shared(ptr);
+    }));
+    CHECK(live == 0);
+    CHECK(ThrowsBadAlloc([] {
+        SharedPtr<Counted, MultiThreaded> shared;
+        Counted* ptr = new Counted;
+        fail_next_allocation = true;
+        shared.Reset(ptr);
+    }));
+    CHECK(live == 0);
+
+    // A UniquePtr keeps its object when the SharedPtr can't be made.
+    calls = 0;
+    UniquePtr<Counted, CountingDeleter> unique(new Counted, CountingDeleter{&calls});
+    CHECK(ThrowsBadAlloc([&] {
+        fail_next_allocation = true;
+        SharedPtr<Counted, MultiThreaded> shared(std::move(unique));
+    }));
+    CHECK(unique && calls == 0 && live == 1);
+    unique.Reset();
+    CHECK(calls == 1 && live == 0);
+}
+
+void TestUniquePtrAdoption() {
+    int calls = 0;
+    UniquePtr<Counted, CountingDeleter> unique(new Counted, CountingDeleter{&calls});
+    SharedPtr<Counted, MultiThreaded> shared(std::move(unique));
+    CHECK(!unique && shared.UseCount() == 1);
+    CountingDeleter* deleter = GetDeleter<CountingDeleter>(shared);
+    CHECK(deleter && deleter->calls == &calls);
+    shared.Reset();
+    CHECK(calls == 1 && live == 0);
+
+    UniquePtr<Shared> esft(new Shared);
+    SharedPtr<Shared, MultiThreaded> from_unique(std::move(esft));
+    CHECK(from_unique->SharedFromThis().UseCount() == 2);
+
+    SharedPtr<Counted, MultiThreaded> empty(UniquePtr<Counted, CountingDeleter>(nullptr));
+    CHECK(!empty && calls == 1);
+}
+
+void TestGetDeleter() {
+    int calls = 0;
+    SharedPtr<Counted, MultiThreaded> custom(new Counted, CountingDeleter{&calls});
+    CHECK(GetDeleter<CountingDeleter>(custom) != nullptr);
+    CHECK(GetDeleter<EmptyDeleter>(custom) == nullptr);
+    CHECK(GetDeleter<DefaultDeleter<Counted>>(custom) == nullptr);
+
+    SharedPtr<Counted, MultiThreaded> plain(new Counted);
+    CHECK(GetDeleter<DefaultDeleter<Counted>>(plain) != nullptr);
+    CHECK(GetDeleter<CountingDeleter>(plain) == nullptr);
+
+    auto made = MakeShared<Counted, MultiThreaded>();
+    CHECK(GetDeleter<DefaultDeleter<Counted>>(made) == nullptr);
+    CHECK(GetDeleter<CountingDeleter>(SharedPtr<Counted, MultiThreaded>()) == nullptr);
+}
+
+}  // namespace
+
+int main() {
+    TestCalledOnce();
+    TestAllocationFailure();
+    TestUniquePtrAdoption();
+    TestGetDeleter();
+    CHECK(live == 0);
+    return 0;
+}
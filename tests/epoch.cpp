@@ -0,0 +1,171 @@
+// Objects retired to EpochDomain survive as long as a reader that may have seen them stays
+// pinned, and are reclaimed once it leaves.
+
+#include "../epoch.h"
+#include "../intrusive.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+std::atomic<int> live{0};
+
+struct Counted {
+    Counted() {
+        ++live;
+    }
+
+    ~Counted() {
+        --live;
+    }
+};
+
+struct Node : AtomicRefCounted<Node, EpochDelete>, Counted {};
+
+// Collect() advances the epoch at most once, and objects wait for two advances.
+void CollectSeveralTimes() {
+    for (int i = 0; i < 4; ++i) {
+        EpochDomain::Collect();
+    }
+}
+
+// A reader thread pinned inside an EpochGuard until Unpin().
+class PinnedReader {
+public:
+    PinnedReader() : thread_([this] { Run(); }) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return pinned_; });
+    }
+
+    ~PinnedReader() {
+        Unpin();
+    }
+
+    void Unpin() {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            release_ = true;
+        }
+        changed_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+private:
+    void Run() {
+        EpochGuard guard;
+        std::unique_lock<std::mutex> lock(mutex_);
+        pinned_ = true;
+        changed_.notify_all();
+        changed_.wait(lock, [this] { return release_; });
+    }
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool pinned_ = false;
+    bool release_ = false;
+    std::thread thread_;
+};
+
+void TestRetireWhilePinned() {
+    PinnedReader reader;
+    EpochDomain::Retire(new Counted);
+    CHECK(live == 1);
+    CollectSeveralTimes();
+    CHECK(live == 1);
+    reader.Unpin();
+    CollectSeveralTimes();
+    CHECK(live == 0);
+}
+
+// Nested guards on the retiring thread itself hold reclamation back as well.
+void TestNestedGuards() {
+    {
+        EpochGuard outer;
+        {
+            EpochGuard inner;
+        }
+        EpochDomain::Retire(new Counted);
+        CollectSeveralTimes();
+        CHECK(live == 1);
+    }
+    CollectSeveralTimes();
+    CHECK(live == 0);
+}
+
+void TestEpochShared() {
+    auto ptr = MakeEpochShared<Counted, MultiThreaded>();
+    WeakPtr<Counted, MultiThreaded> weak = ptr;
+    {
+        PinnedReader reader;
+        ptr.Reset();
+        CHECK(weak.Expired());
+        CollectSeveralTimes();
+        CHECK(live == 1);
+    }
+    CollectSeveralTimes();
+    CHECK(live == 0);
+    weak.Reset();
+
+    // Without weak references the block goes with the object.
+    {
+        PinnedReader reader;
+        MakeEpochShared<Counted, SingleThreaded>();
+        CollectSeveralTimes();
+        CHECK(live == 1);
+    }
+    CollectSeveralTimes();
+    CHECK(live == 0);
+}
+
+void TestEpochDelete() {
+    {
+        PinnedReader reader;
+        IntrusivePtr<Node> node = MakeIntrusive<Node>();
+        node.Reset();
+        CollectSeveralTimes();
+        CHECK(live == 1);
+    }
+    CollectSeveralTimes();
+    CHECK(live == 0);
+}
+
+// Objects a thread leaves behind on exit are reclaimed by other threads' collections.
+void TestOrphans() {
+    std::thread([] {
+        for (int i = 0; i < 10; ++i) {
+            EpochDomain::Retire(new Counted);
+        }
+    }).join();
+    CHECK(live == 10);
+    CollectSeveralTimes();
+    CHECK(live == 0);
+}
+
+// Retiring past kCollectThreshold collects on its own.
+void TestThreshold() {
+    for (size_t i = 0; i < 4 * EpochDomain::kCollectThreshold; ++i) {
+        EpochDomain::Retire(new Counted);
+    }
+    CHECK(live < static_cast<int>(4 * EpochDomain::kCollectThreshold));
+    CollectSeveralTimes();
+    CHECK(live == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestRetireWhilePinned();
+    TestNestedGuards();
+    TestEpochShared();
+    TestEpochDelete();
+    TestOrphans();
+    TestThreshold();
+    return 0;
+}
@@ -0,0 +1,178 @@
+// IntrusiveWeakPtr and its side table: locks after the object is gone, the table outliving
+// the object until the last weak pointer, and Lock() racing the last DecRef.
+
+#include "../intrusive.h"
+#include "check.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Heap blocks allocated and not yet freed, to see the side table come and go.
+std::atomic<int> heap_blocks{0};
+
+}  // namespace
+
+void* operator new(size_t size) {
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        ++heap_blocks;
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr) {
+        --heap_blocks;
+        std::free(ptr);
+    }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+namespace {
+
+std::atomic<int> live{0};
+std::atomic<int> destroyed{0};
+
+struct Node : WeakRefCounted<Node> {
+    Node() {
+        ++live;
+    }
+
+    ~Node() {
+        --live;
+        ++destroyed;
+    }
+
+    int value = 42;
+};
+
+struct Derived : Node {};
+
+void TestLockAfterDeath() {
+    destroyed = 0;
+    IntrusivePtr<Node> ptr = MakeIntrusive<Node>();
+    IntrusiveWeakPtr<Node> weak = ptr;
+    IntrusiveWeakPtr<Node> copy = weak;
+    CHECK(!weak.Expired() && weak.Lock().Get() == ptr.Get());
+    CHECK(ptr->RefCount() == 1);
+
+    ptr.Reset();
+    CHECK(live == 0 && destroyed == 1);
+    CHECK(weak.Expired() && copy.Expired());
+    CHECK(!weak.Lock() && !copy.Lock());
+
+    IntrusiveWeakPtr<Node> empty;
+    CHECK(empty.Expired() && !empty.Lock());
+    IntrusiveWeakPtr<Node> from_null = IntrusivePtr<Node>();
+    CHECK(from_null.Expired() && !from_null.Lock());
+
+    // Weak pointers to a base class lock the same object.
+    IntrusivePtr<Derived> derived = MakeIntrusive<Derived>();
+    IntrusiveWeakPtr<Derived> weak_derived = derived;
+    IntrusiveWeakPtr<Node> weak_base = weak_derived;
+    CHECK(weak_base.Lock().Get() == derived.Get());
+    CHECK(derived->RefCount() == 1);
+    derived.Reset();
+    CHECK(weak_base.Expired() && !weak_base.Lock() && live == 0);
+}
+
+void TestSideTable() {
+    int before = heap_blocks;
+    IntrusivePtr<Node> ptr = MakeIntrusive<Node>();
+    // No weak pointer, no side table.
+    CHECK(heap_blocks == before + 1);
+    ptr.Reset();
+    CHECK(heap_blocks == before);
+
+    ptr = MakeIntrusive<Node>();
+    IntrusiveWeakPtr<Node> weak = ptr;
+    IntrusiveWeakPtr<Node> other = ptr;
+    IntrusiveWeakPtr<Node> copy = weak;
+    CHECK(heap_blocks == before + 2);
+    ptr.Reset();
+    CHECK(live == 0 && heap_blocks == before + 1);
+    weak.Reset();
+    other = IntrusiveWeakPtr<Node>();
+    CHECK(heap_blocks == before + 1 && copy.Expired());
+    copy.Reset();
+    CHECK(heap_blocks == before);
+
+    // Weak pointers gone before the object: the object frees the table.
+    ptr = MakeIntrusive<Node>();
+    IntrusiveWeakPtr<Node>(ptr).Reset();
+    CHECK(heap_blocks == before + 2);
+    ptr.Reset();
+    CHECK(heap_blocks == before);
+}
+
+// Threads making the first weak pointers at once agree on one side table.
+void TestConcurrentFirstWeak() {
+    constexpr int kThreads = 4;
+    constexpr int kRounds = 500;
+
+    for (int round = 0; round < kRounds; ++round) {
+        IntrusivePtr<Node> ptr = MakeIntrusive<Node>();
+        std::vector<IntrusiveWeakPtr<Node>> weaks(kThreads);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kThreads; ++i) {
+            threads.emplace_back([&ptr, &weak = weaks[i]] { weak = ptr; });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        int before = heap_blocks;
+        ptr.Reset();
+        for (IntrusiveWeakPtr<Node>& weak : weaks) {
+            CHECK(weak.Expired());
+        }
+        CHECK(heap_blocks == before - 1);
+        weaks.clear();
+        CHECK(heap_blocks == before - 2);
+    }
+    CHECK(live == 0);
+}
+
+// The last strong reference is dropped on one thread while another keeps locking: every lock
+// either fails or gets a live object, and the object is destroyed exactly once.
+void TestLockRacesDecRef() {
+    constexpr int kRounds = 300;
+
+    destroyed = 0;
+    for (int round = 0; round < kRounds; ++round) {
+        IntrusivePtr<Node> ptr = MakeIntrusive<Node>();
+        IntrusiveWeakPtr<Node> weak = ptr;
+        std::atomic<bool> started{false};
+        std::thread locker([&] {
+            started.store(true);
+            while (IntrusivePtr<Node> locked = weak.Lock()) {
+                CHECK(locked->value == 42 && live == 1);
+            }
+        });
+        while (!started.load()) {
+            std::this_thread::yield();
+        }
+        std::thread([moved = std::move(ptr)]() mutable { moved.Reset(); }).join();
+        locker.join();
+        CHECK(weak.Expired() && !weak.Lock());
+        CHECK(live == 0 && destroyed == round + 1);
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestLockAfterDeath();
+    TestSideTable();
+    TestConcurrentFirstWeak();
+    TestLockRacesDecRef();
+    return 0;
+}
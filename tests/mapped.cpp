@@ -0,0 +1,90 @@
+// MapFile creates, reopens and refuses files; OffsetPtr links survive remapping.
+
+#include "../mapped.h"
+#include "check.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct Node {
+    int value;
+    MappedPtr<Node> next;
+};
+
+std::string TempPath() {
+    char path[] = "/tmp/smart_pointers_mapped_XXXXXX";
+    int fd = ::mkstemp(path);
+    CHECK(fd >= 0);
+    ::close(fd);
+    return path;
+}
+
+size_t FileSize(const std::string& path) {
+    struct stat info;
+    CHECK(::stat(path.c_str(), &info) == 0);
+    return info.st_size;
+}
+
+template <typename Function>
+bool ThrowsEinval(Function function) {
+    try {
+        function();
+    } catch (const std::system_error& error) {
+        return error.code().value() == EINVAL;
+    }
+    return false;
+}
+
+void TestRemap() {
+    std::string path = TempPath();
+    {
+        MappedFile file = MapFile(path.c_str(), 1 << 16);
+        Node* head = file->Create<Node>(Node{1, nullptr});
+        head->next.Reset(file->Create<Node>(Node{2, nullptr}));
+        file->SetRoot(head);
+    }
+    // The size argument is ignored for an existing region.
+    MappedFile file = MapFile(path.c_str(), 1 << 20);
+    CHECK(file->GetSize() == 1 << 16);
+    Node* head = file->GetRoot<Node>();
+    CHECK(head->value == 1 && head->next->value == 2);
+    ::unlink(path.c_str());
+}
+
+void TestForeignFileIsLeftAlone() {
+    std::string path = TempPath();
+    FILE* stream = std::fopen(path.c_str(), "w");
+    std::fputs("not a region, but long enough to have a header", stream);
+    std::fclose(stream);
+    size_t size = FileSize(path);
+    CHECK(ThrowsEinval([&] { MapFile(path.c_str(), 1 << 16); }));
+    CHECK(FileSize(path) == size);
+    ::unlink(path.c_str());
+}
+
+void TestTruncatedRegionIsRefused() {
+    std::string path = TempPath();
+    MapFile(path.c_str(), 1 << 16);
+    CHECK(::truncate(path.c_str(), 1 << 12) == 0);
+    CHECK(ThrowsEinval([&] { MapFile(path.c_str(), 1 << 16); }));
+    CHECK(::truncate(path.c_str(), 8) == 0);
+    CHECK(ThrowsEinval([&] { MapFile(path.c_str(), 1 << 16); }));
+    ::unlink(path.c_str());
+}
+
+}  // namespace
+
+int main() {
+    TestRemap();
+    TestForeignFileIsLeftAlone();
+    TestTruncatedRegionIsRefused();
+    return 0;
+}
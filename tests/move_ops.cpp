@@ -0,0 +1,84 @@
+// Built with SMART_POINTERS_COUNT_OPS: moving SharedPtr and WeakPtr must perform no
+// reference count operations at all.
+
+#include "../shared.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <optional>
+#include <utility>
+
+static_assert(kCountRefOps, "this test needs SMART_POINTERS_COUNT_OPS");
+
+namespace {
+
+struct Base {
+    virtual ~Base() = default;
+    int base = 1;
+};
+
+struct Derived : Base {
+    int derived = 2;
+};
+
+// Runs `function` and checks it did not touch any count on this thread.
+template <typename Function>
+void CheckNoOps(Function function) {
+    RefCountOps before = ThreadRefCountOps();
+    function();
+    RefCountOps after = ThreadRefCountOps();
+    CHECK(after.increments == before.increments);
+    CHECK(after.decrements == before.decrements);
+    CHECK(after.weak_increments == before.weak_increments);
+    CHECK(after.weak_decrements == before.weak_decrements);
+}
+
+// Targets of move assignments are empty: releasing a previous value is a real decrement.
+template <typename Policy>
+void TestSharedMoves() {
+    SharedPtr<Derived, Policy> source = MakeShared<Derived, Policy>();
+    std::optional<SharedPtr<Derived, Policy>> constructed;
+    SharedPtr<Derived, Policy> assigned;
+    std::optional<SharedPtr<Base, Policy>> converted;
+    SharedPtr<Base, Policy> converted_assigned;
+    std::optional<SharedPtr<int, Policy>> aliased;
+
+    CheckNoOps([&] { constructed.emplace(std::move(source)); });
+    CheckNoOps([&] { assigned = std::move(*constructed); });
+    CheckNoOps([&] { converted.emplace(std::move(assigned)); });
+    CheckNoOps([&] { converted_assigned = std::move(*converted); });
+    CheckNoOps([&] {
+        int* member = &converted_assigned->base;
+        aliased.emplace(std::move(converted_assigned), member);
+    });
+    CHECK(!source && !*constructed && !assigned && !*converted && !converted_assigned);
+    CHECK(aliased->UseCount() == 1);
+    CHECK(**aliased == 1);
+}
+
+template <typename Policy>
+void TestWeakMoves() {
+    SharedPtr<Derived, Policy> owner = MakeShared<Derived, Policy>();
+    WeakPtr<Derived, Policy> source = owner;
+    std::optional<WeakPtr<Derived, Policy>> constructed;
+    WeakPtr<Derived, Policy> assigned;
+    std::optional<WeakPtr<Base, Policy>> converted;
+    WeakPtr<Base, Policy> converted_assigned;
+
+    CheckNoOps([&] { constructed.emplace(std::move(source)); });
+    CheckNoOps([&] { assigned = std::move(*constructed); });
+    CheckNoOps([&] { converted.emplace(std::move(assigned)); });
+    CheckNoOps([&] { converted_assigned = std::move(*converted); });
+    CHECK(converted_assigned.UseCount() == 1);
+    CHECK(converted_assigned.Lock()->base == 1);
+}
+
+}  // namespace
+
+int main() {
+    TestSharedMoves<SingleThreaded>();
+    TestSharedMoves<MultiThreaded>();
+    TestWeakMoves<SingleThreaded>();
+    TestWeakMoves<MultiThreaded>();
+    return 0;
+}
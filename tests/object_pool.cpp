@@ -0,0 +1,99 @@
+// MakeIntrusive(FromPool(), ...) and PoolDelete recycle object storage through ObjectPool,
+// on the same thread, across threads and when a constructor throws.
+
+#include "../object_pool.h"
+#include "check.h"
+
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int live = 0;
+
+struct Message : AtomicRefCounted<Message, PoolDelete> {
+    explicit Message(int value, bool fail = false) : value(value) {
+        if (fail) {
+            throw std::runtime_error("Message");
+        }
+        ++live;
+    }
+
+    ~Message() {
+        --live;
+    }
+
+    int value;
+    char payload[100];
+};
+
+using Pool = ObjectPool<Message>;
+
+void TestRecycling() {
+    IntrusivePtr<Message> first = MakeIntrusive<Message>(FromPool(), 1);
+    const Message* address = first.Get();
+    IntrusivePtr<Message> copy = first;
+    first.Reset();
+    CHECK(live == 1);
+    copy.Reset();
+    CHECK(live == 0);
+    // The thread's free list is LIFO: the same slot comes back.
+    IntrusivePtr<Message> second = MakeIntrusive<Message>(FromPool(), 2);
+    CHECK(second.Get() == address);
+    CHECK(second->value == 2);
+}
+
+void TestThrowingConstructor() {
+    IntrusivePtr<Message> message = MakeIntrusive<Message>(FromPool(), 1);
+    const Message* address = message.Get();
+    message.Reset();
+    bool threw = false;
+    try {
+        MakeIntrusive<Message>(FromPool(), 2, true);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw && live == 0);
+    CHECK(MakeIntrusive<Message>(FromPool(), 3).Get() == address);
+}
+
+// Objects made on one thread die on another, which exits; its slots go back to the depot
+// and a third thread gets them without asking operator new.
+void TestCrossThread() {
+    constexpr size_t kCount = 4 * Pool::kBatchSize;
+    std::vector<IntrusivePtr<Message>> messages;
+    std::set<const Message*> addresses;
+    std::thread([&] {
+        for (size_t i = 0; i < kCount; ++i) {
+            messages.push_back(MakeIntrusive<Message>(FromPool(), static_cast<int>(i)));
+            addresses.insert(messages.back().Get());
+        }
+    }).join();
+    std::thread([&] { messages.clear(); }).join();
+    CHECK(live == 0);
+
+    std::thread([&] {
+        Pool::Stats before = Pool::GetStats();
+        for (size_t i = 0; i < Pool::kBatchSize; ++i) {
+            messages.push_back(MakeIntrusive<Message>(FromPool(), 0));
+            CHECK(addresses.count(messages.back().Get()) == 1);
+        }
+        // Exactly a batch, so the thread has reported its counts.
+        Pool::Stats after = Pool::GetStats();
+        CHECK(after.hits - before.hits == Pool::kBatchSize);
+        CHECK(after.misses == before.misses);
+        messages.clear();
+    }).join();
+    CHECK(live == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestRecycling();
+    TestThrowingConstructor();
+    TestCrossThread();
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Sharded counts across threads: references handed between threads, WeakPtr::Lock racing
+// the last release, and direct references taken again after the counts were reconciled.
+// Every object has to be destroyed exactly once.
+
+#include "../scalable.h"
+#include "../shared.h"
+#include "../weak.h"
+#include "check.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::atomic<int> live{0};
+std::atomic<int> destroyed{0};
+
+struct Counted {
+    Counted() {
+        ++live;
+    }
+
+    ~Counted() {
+        --live;
+        ++destroyed;
+    }
+};
+
+using Ptr = SharedPtr<Counted, Sharded>;
+using Weak = WeakPtr<Counted, Sharded>;
+
+// References handed from the threads that made them to threads that drop them.
+class Queue {
+public:
+    void Push(Ptr ptr) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        ptrs_.push_back(std::move(ptr));
+    }
+
+    bool Pop(Ptr& ptr) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (ptrs_.empty()) {
+            return false;
+        }
+        ptr = std::move(ptrs_.front());
+        ptrs_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::deque<Ptr> ptrs_;
+};
+
+void TestSingleThread() {
+    destroyed = 0;
+    Ptr ptr = MakeSharedScalable<Counted>();
+    Weak weak = ptr;
+    Ptr copy = ptr;
+    CHECK(ptr.UseCount() == 2 && weak.UseCount() == 2);
+    ptr.Reset();
+    CHECK(live == 1 && copy.UseCount() == 1);
+    Ptr locked = weak.Lock();
+    CHECK(locked.UseCount() == 2);
+    copy.Reset();
+    locked.Reset();
+    CHECK(live == 0 && destroyed == 1);
+    CHECK(weak.Expired() && !weak.Lock());
+}
+
+void TestHandOff() {
+    constexpr int kProducers = 4;
+    constexpr int kConsumers = 4;
+    constexpr int kCopies = 20000;
+
+    destroyed = 0;
+    Ptr source = MakeSharedScalable<Counted>();
+    Weak weak = source;
+    Queue queue;
+    std::atomic<int> producing{kProducers};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kProducers; ++i) {
+        threads.emplace_back([&] {
+            Ptr own = source;
+            for (int j = 0; j < kCopies; ++j) {
+                queue.Push(own);
+            }
+            producing.fetch_sub(1);
+        });
+    }
+    for (int i = 0; i < kConsumers; ++i) {
+        threads.emplace_back([&] {
+            Ptr ptr;
+            while (producing.load() != 0 || queue.Pop(ptr)) {
+                if (queue.Pop(ptr)) {
+                    Ptr copy = ptr;
+                    ptr.Reset();
+                    CHECK(copy && live == 1);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(source.UseCount() == 1 && live == 1);
+
+    // The last reference is dropped on a thread that never saw the object before.
+    std::thread([moved = std::move(source)]() mutable { moved.Reset(); }).join();
+    CHECK(live == 0 && destroyed == 1);
+    CHECK(weak.Expired() && !weak.Lock());
+}
+
+// One thread drops the first reference while another churns copies of its own and a third
+// keeps locking a WeakPtr: the last release may come from any of them, and locks may hit
+// the object after its direct count has drained to zero.
+void TestLockRacesRelease() {
+    constexpr int kRounds = 500;
+
+    destroyed = 0;
+    for (int round = 0; round < kRounds; ++round) {
+        Ptr ptr = MakeSharedScalable<Counted>();
+        Weak weak = ptr;
+        std::atomic<bool> started{false};
+        std::thread churn([&started, copy = ptr]() mutable {
+            started.store(true);
+            for (int i = 0; i < 100; ++i) {
+                Ptr other = copy;
+                copy.Reset();
+                copy = std::move(other);
+            }
+        });
+        std::thread locker([&weak] {
+            while (Ptr locked = weak.Lock()) {
+                CHECK(live == 1);
+                Ptr copy = locked;
+            }
+        });
+        while (!started.load()) {
+            std::this_thread::yield();
+        }
+        ptr.Reset();
+        churn.join();
+        locker.join();
+        CHECK(weak.Expired() && !weak.Lock());
+        CHECK(live == 0 && destroyed == round + 1);
+    }
+}
+
+// Locks and releases on many threads while one reference stays put. Whenever the direct
+// count drains to zero under references counted in slots, the next lock takes it back to
+// one, and the object has to stay alive throughout.
+void TestDirectCountRevived() {
+    constexpr int kThreads = 4;
+    constexpr int kIterations = 20000;
+
+    destroyed = 0;
+    Ptr ptr = MakeSharedScalable<Counted>();
+    Weak weak = ptr;
+    Ptr keeper = ptr;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([&weak] {
+            for (int j = 0; j < kIterations; ++j) {
+                Ptr locked = weak.Lock();
+                CHECK(locked && live == 1);
+                Ptr copy = locked;
+                locked.Reset();
+                std::this_thread::yield();
+            }
+        });
+    }
+    ptr.Reset();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(keeper.UseCount() == 1 && live == 1);
+    keeper.Reset();
+    CHECK(live == 0 && destroyed == 1);
+    CHECK(weak.Expired() && !weak.Lock());
+}
+
+}  // namespace
+
+int main() {
+    TestSingleThread();
+    TestHandOff();
+    TestLockRacesRelease();
+    TestDirectCountRevived();
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Shares ShmSharedPtrs with forked children and checks the counts after they exit.
+
+#include "../shm_shared.h"
+#include "check.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct Node {
+    int value;
+    ShmOffset next;  // A Share()d reference to another Node, or 0.
+};
+
+// Runs `child` in a forked process and waits for it to exit cleanly.
+template <typename Function>
+void InChild(Function child) {
+    pid_t pid = ::fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        child();
+        // Skips the destructors of the handles inherited from the parent: they hold no
+        // references of the child's own.
+        ::_exit(0);
+    }
+    int status = 0;
+    CHECK(::waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void TestChildReleasesItsReference() {
+    auto segment = SharedSegment::Create(1 << 20);
+    auto node = MakeShmShared<Node>(segment, Node{1, 0});
+    ShmOffset offset = node.Share();
+    CHECK(node.UseCount() == 2);
+    InChild([&] {
+        auto adopted = ShmSharedPtr<Node>::Adopt(segment, offset);
+        adopted->value = 2;
+        auto copy = adopted;
+        if (copy.UseCount() != 3) {
+            ::_exit(1);
+        }
+    });
+    CHECK(node.UseCount() == 1);
+    CHECK(node->value == 2);
+}
+
+// The child allocates an object and hands a reference to the parent through the segment.
+void TestChildHandsBackAnObject() {
+    auto segment = SharedSegment::Create(1 << 20);
+    auto node = MakeShmShared<Node>(segment, Node{1, 0});
+    ShmWeakPtr<Node> weak_child;
+    InChild([&] {
+        auto child = MakeShmShared<Node>(segment, Node{3, 0});
+        node->next = child.Share();
+    });
+    CHECK(node->next != 0);
+    auto child = ShmSharedPtr<Node>::Adopt(segment, node->next);
+    CHECK(child.UseCount() == 1);
+    CHECK(child->value == 3);
+    weak_child = child;
+    child.Reset();
+    CHECK(weak_child.Expired());
+}
+
+// A child mapping the segment anew, from its file descriptor.
+void TestChildOpensTheSegment() {
+    auto segment = SharedSegment::Create(1 << 20);
+    auto node = MakeShmShared<Node>(segment, Node{1, 0});
+    ShmWeakPtr<Node> weak = node;
+    ShmOffset offset = weak.Share();
+    InChild([&] {
+        auto opened = SharedSegment::Open(segment.GetFd());
+        auto weak = ShmWeakPtr<Node>::Adopt(opened, offset);
+        auto locked = weak.Lock();
+        if (!locked || locked->value != 1) {
+            ::_exit(1);
+        }
+        locked->value = 4;
+    });
+    CHECK(node.UseCount() == 1);
+    CHECK(node->value == 4);
+    node.Reset();
+    CHECK(weak.Expired());
+}
+
+}  // namespace
+
+int main() {
+    TestChildReleasesItsReference();
+    TestChildHandsBackAnObject();
+    TestChildOpensTheSegment();
+    return 0;
+}
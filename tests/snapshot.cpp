@@ -0,0 +1,59 @@
+// SnapshotCell::Get() references must survive Get()s on other cells.
+
+#include "../snapshot.h"
+#include "check.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// The second cell's first Get() grows the thread's cache past the first cell's entry.
+void TestTwoCells() {
+    SnapshotCell<std::string> a(MakeShared<std::string, MultiThreaded>("a"));
+    SnapshotCell<std::string> b(MakeShared<std::string, MultiThreaded>("b"));
+    const auto& ra = a.Get();
+    const auto& rb = b.Get();
+    CHECK(*ra == "a");
+    CHECK(*rb == "b");
+}
+
+void TestManyCells() {
+    std::vector<std::unique_ptr<SnapshotCell<int>>> cells;
+    std::vector<const SnapshotCell<int>::Snapshot*> seen;
+    for (int i = 0; i < 100; ++i) {
+        cells.push_back(std::make_unique<SnapshotCell<int>>());
+        cells.back()->Emplace(i);
+        seen.push_back(&cells.back()->Get());
+    }
+    for (int i = 0; i < 100; ++i) {
+        CHECK(**seen[i] == i);
+        CHECK(&cells[i]->Get() == seen[i]);
+    }
+}
+
+void TestPublish() {
+    SnapshotCell<int> cell;
+    cell.Emplace(1);
+    auto kept = cell.Load();
+    CHECK(*cell.Get() == 1);
+    cell.Emplace(2);
+    CHECK(*cell.Get() == 2);
+    CHECK(*kept == 1);
+    CHECK(kept.UseCount() == 1);
+
+    int other = 0;
+    std::thread([&] { other = *cell.Get(); }).join();
+    CHECK(other == 2);
+}
+
+}  // namespace
+
+int main() {
+    TestTwoCells();
+    TestManyCells();
+    TestPublish();
+    return 0;
+}
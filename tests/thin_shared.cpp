@@ -0,0 +1,111 @@
+// ThinSharedPtr and ThinWeakPtr lifetimes, narrowing from SharedPtr, and conversions back,
+// including from empty handles to types using EnableSharedFromThis.
+
+#include "../thin_shared.h"
+#include "check.h"
+
+#include <utility>
+
+namespace {
+
+int live = 0;
+
+struct Counted {
+    explicit Counted(int value = 0) : value(value) {
+        ++live;
+    }
+
+    ~Counted() {
+        --live;
+    }
+
+    int value;
+};
+
+struct Shared : EnableSharedFromThis<Shared, MultiThreaded> {
+    int value = 5;
+};
+
+using Thin = ThinSharedPtr<Counted, MultiThreaded>;
+using ThinWeak = ThinWeakPtr<Counted, MultiThreaded>;
+using Fat = SharedPtr<Counted, MultiThreaded>;
+
+static_assert(sizeof(Thin) == sizeof(void*));
+static_assert(sizeof(ThinWeak) == sizeof(void*));
+
+void TestLifetime() {
+    {
+        Thin thin = MakeThinShared<Counted, MultiThreaded>(1);
+        CHECK(thin->value == 1 && thin.UseCount() == 1);
+        Thin copy = thin;
+        Thin moved = std::move(copy);
+        CHECK(!copy && thin.UseCount() == 2);
+        ThinWeak weak = thin;
+        thin.Reset();
+        CHECK(!weak.Expired() && weak.Lock()->value == 1);
+        moved.Reset();
+        CHECK(live == 0);
+        CHECK(weak.Expired() && !weak.Lock());
+    }
+    CHECK(live == 0);
+}
+
+void TestConversions() {
+    Thin thin = MakeThinShared<Counted, MultiThreaded>(2);
+    Fat fat = thin;
+    CHECK(fat.Get() == thin.Get() && fat.UseCount() == 2);
+    Fat taken = Thin(thin);
+    CHECK(taken.UseCount() == 3);
+
+    Thin back(fat);
+    CHECK(back.Get() == fat.Get() && fat.UseCount() == 4);
+    Thin moved_back(std::move(taken));
+    CHECK(!taken && fat.UseCount() == 4);
+
+    // Only MakeShared blocks pointing to the whole object can be narrowed.
+    bool threw = false;
+    try {
+        Thin narrowed{Fat(new Counted(3))};
+    } catch (const BadThinPtr&) {
+        threw = true;
+    }
+    CHECK(threw);
+    threw = false;
+    SharedPtr<int, MultiThreaded> member(fat, &fat->value);
+    try {
+        ThinSharedPtr<int, MultiThreaded> narrowed(member);
+    } catch (const BadThinPtr&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(!Thin(Fat()));
+}
+
+// An empty handle converts to an empty SharedPtr without touching the object hook.
+void TestEmptyConversions() {
+    ThinSharedPtr<Shared, MultiThreaded> empty;
+    SharedPtr<Shared, MultiThreaded> copied = empty;
+    CHECK(!copied && copied.UseCount() == 0);
+    SharedPtr<Shared, MultiThreaded> moved = std::move(empty);
+    CHECK(!moved);
+    Fat plain = Thin();
+    CHECK(!plain);
+}
+
+void TestSharedFromThis() {
+    auto thin = MakeThinShared<Shared, MultiThreaded>();
+    SharedPtr<Shared, MultiThreaded> self = thin->SharedFromThis();
+    CHECK(self.Get() == thin.Get() && thin.UseCount() == 2);
+    SharedPtr<Shared, MultiThreaded> fat = std::move(thin);
+    CHECK(fat->value == 5 && fat.UseCount() == 2);
+}
+
+}  // namespace
+
+int main() {
+    TestLifetime();
+    TestConversions();
+    TestEmptyConversions();
+    TestSharedFromThis();
+    return 0;
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "shared.h"
+#include "weak.h"
+
+#include <cstddef>  // std::nullptr_t
+#include <exception>
+#include <utility>
+
+// Thrown when a SharedPtr can't be narrowed to a ThinSharedPtr.
+class BadThinPtr : public std::exception {};
+
+template <typename T, typename Policy = DefaultPolicy>
+class ThinWeakPtr;
+
+// Single-word shared pointer to an object made by MakeShared<T, Policy>: it keeps only the
+// block, the object sits at a fixed offset inside it. Converts to SharedPtr implicitly;
+// the way back is explicit and throws BadThinPtr unless the SharedPtr owns such a block
+// and points to the whole object (no aliasing, no base class subobject).
+template <typename T, typename Policy>
+class ThinSharedPtr {
+    template <typename Y, typename P>
+    friend class ThinWeakPtr;
+
+    using Holder = ControlBlockHolder<T, Policy>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    constexpr ThinSharedPtr() noexcept : holder_(nullptr) {
+    }
+
+    constexpr ThinSharedPtr(std::nullptr_t) noexcept : ThinSharedPtr() {
+    }
+
+    explicit ThinSharedPtr(const SharedPtr<T, Policy>& other) : holder_(Narrow(other)) {
+        AddRef();
+    }
+
+    explicit ThinSharedPtr(SharedPtr<T, Policy>&& other) : holder_(Narrow(other)) {
+        other.observed_ = nullptr;
+        other.block_ = nullptr;
+    }
+
+    ThinSharedPtr(const ThinSharedPtr& other) noexcept : holder_(other.holder_) {
+        AddRef();
+    }
+
+    ThinSharedPtr(ThinSharedPtr&& other) noexcept : holder_(std::exchange(other.holder_, nullptr)) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+    ThinSharedPtr& operator=(const ThinSharedPtr& other) noexcept {
+        ThinSharedPtr(other).Swap(*this);
+        return *this;
+    }
+
+    ThinSharedPtr& operator=(ThinSharedPtr&& other) noexcept {
+        ThinSharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~ThinSharedPtr() {
+        if (holder_) {
+            holder_->Release();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Conversions
+    operator SharedPtr<T, Policy>() const& noexcept {
+        AddRef();
+        return SharedPtr<T, Policy>(AdoptBlock(), Get(), holder_);
+    }
+
+    operator SharedPtr<T, Policy>() && noexcept {
+        T* ptr = Get();
+        return SharedPtr<T, Policy>(AdoptBlock(), ptr, std::exchange(holder_, nullptr));
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Reset() noexcept {
+        ThinSharedPtr().Swap(*this);
+    }
+
+    void Swap(ThinSharedPtr& other) noexcept {
+        std::swap(holder_, other.holder_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    T* Get() const noexcept {
+        return holder_ ? holder_->GetPointer() : nullptr;
+    }
+
+    T& operator*() const noexcept {
+        return *Get();
+    }
+
+    T* operator->() const noexcept {
+        return Get();
+    }
+
+    size_t UseCount() const noexcept {
+        if (!holder_) {
+            return 0;
+        }
+        return holder_->GetReferenceCount();
+    }
+
+    explicit operator bool() const noexcept {
+        return holder_ != nullptr;
+    }
+
+private:
+    static Holder* Narrow(const SharedPtr<T, Policy>& other) {
+        if (!other.block_) {
+            return nullptr;
+        }
+        Holder* holder = Holder::Cast(other.block_);
+        if (!holder || holder->GetPointer() != other.observed_) {
+            throw BadThinPtr();
+        }
+        return holder;
+    }
+
+    void AddRef() const {
+        if (holder_) {
+            holder_->Increment();
+        }
+    }
+
+    Holder* holder_;
+};
+
+template <typename T, typename Policy>
+class ThinWeakPtr {
+    using Holder = ControlBlockHolder<T, Policy>;
+
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+    constexpr ThinWeakPtr() noexcept : holder_(nullptr) {
+    }
+
+    ThinWeakPtr(const ThinSharedPtr<T, Policy>& other) noexcept : holder_(other.holder_) {
+        AddRef();
+    }
+
+    ThinWeakPtr(const ThinWeakPtr& other) noexcept : holder_(other.holder_) {
+        AddRef();
+    }
+
+    ThinWeakPtr(ThinWeakPtr&& other) noexcept : holder_(std::exchange(other.holder_, nullptr)) {
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+    ThinWeakPtr& operator=(const ThinWeakPtr& other) noexcept {
+        ThinWeakPtr(other).Swap(*this);
+        return *this;
+    }
+
+    ThinWeakPtr& operator=(ThinWeakPtr&& other) noexcept {
+        ThinWeakPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+    ~ThinWeakPtr() {
+        if (holder_) {
+            holder_->ReleaseWeak();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+    void Reset() noexcept {
+        ThinWeakPtr().Swap(*this);
+    }
+
+    void Swap(ThinWeakPtr& other) noexcept {
+        std::swap(holder_, other.holder_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+    size_t UseCount() const noexcept {
+        if (!holder_) {
+            return 0;
+        }
+        return holder_->GetReferenceCount();
+    }
+
+    bool Expired() const noexcept {
+        return UseCount() == 0;
+    }
+
+    ThinSharedPtr<T, Policy> Lock() const noexcept {
+        ThinSharedPtr<T, Policy> shared;
+        if (holder_ && holder_->IncrementIfNotZero()) {
+            shared.holder_ = holder_;
+        }
+        return shared;
+    }
+
+private:
+    void AddRef() {
+        if (holder_) {
+            holder_->IncrementWeak();
+        }
+    }
+
+    Holder* holder_;
+};
+
+template <typename T, typename Policy = DefaultPolicy, typename... Args>
+ThinSharedPtr<T, Policy> MakeThinShared(Args&&... args) {
+    return ThinSharedPtr<T, Policy>(MakeShared<T, Policy>(std::forward<Args>(args)...));
+}
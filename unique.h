@@ -3,6 +3,8 @@
 #include "compressed_pair.h"
 
 #include <cstddef>  // std::nullptr_t
+#include <type_traits>
+#include <utility>
 
 template<typename T>
 struct DefaultDeleter {
@@ -30,16 +32,29 @@ struct DefaultDeleter<T[]> {
     }
 };
 
+// Stored pointer type: Deleter::pointer if the deleter defines one, T* otherwise.
+template<typename T, typename Deleter, typename = void>
+struct UniquePointer {
+    using Type = T *;
+};
+
+template<typename T, typename Deleter>
+struct UniquePointer<T, Deleter, std::void_t<typename std::remove_reference_t<Deleter>::pointer>> {
+    using Type = typename std::remove_reference_t<Deleter>::pointer;
+};
+
 // Primary template
 template<typename T, typename Deleter = DefaultDeleter<T>>
 class UniquePtr {
 public:
+    using Pointer = typename UniquePointer<T, Deleter>::Type;
+
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Constructors
-    explicit UniquePtr(T *ptr = nullptr) noexcept: ptr_(ptr, Deleter()) {
+    explicit UniquePtr(Pointer ptr = nullptr) noexcept: ptr_(ptr, Deleter()) {
     }
 
-    UniquePtr(T *ptr, Deleter deleter) : ptr_(ptr, std::forward<decltype(deleter)>(deleter)) {
+    UniquePtr(Pointer ptr, Deleter deleter) : ptr_(ptr, std::forward<decltype(deleter)>(deleter)) {
     }
 
     template<typename V, typename D>
@@ -78,14 +93,14 @@ public:
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Modifiers
-    T *Release() noexcept {
-        T *old = Get();
+    Pointer Release() noexcept {
+        Pointer old = Get();
         ptr_.GetFirst() = nullptr;
         return old;
     }
 
-    void Reset(T *ptr = nullptr) noexcept {
-        T *old_ptr = Get();
+    void Reset(Pointer ptr = nullptr) noexcept {
+        Pointer old_ptr = Get();
         ptr_.GetFirst() = ptr;
         if (old_ptr) {
             GetDeleter()(old_ptr);
@@ -99,7 +114,7 @@ public:
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Observers
-    T *Get() const noexcept {
+    Pointer Get() const noexcept {
         return ptr_.GetFirst();
     }
 
@@ -121,24 +136,26 @@ public:
         return *Get();
     }
 
-    T *operator->() const noexcept {
+    Pointer operator->() const noexcept {
         return Get();
     }
 
 private:
-    CompressedPair<T *, Deleter> ptr_;
+    CompressedPair<Pointer, Deleter> ptr_;
 };
 
 // Specialization for arrays
 template<typename T, typename Deleter>
 class UniquePtr<T[], Deleter> {
 public:
+    using Pointer = typename UniquePointer<T, Deleter>::Type;
+
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Constructors
-    explicit UniquePtr(T *ptr = nullptr) noexcept: ptr_(ptr, Deleter()) {
+    explicit UniquePtr(Pointer ptr = nullptr) noexcept: ptr_(ptr, Deleter()) {
     }
 
-    UniquePtr(T *ptr, Deleter deleter) : ptr_(ptr, std::forward<decltype(deleter)>(deleter)) {
+    UniquePtr(Pointer ptr, Deleter deleter) : ptr_(ptr, std::forward<decltype(deleter)>(deleter)) {
     }
 
     template<typename V, typename D>
@@ -177,14 +194,14 @@ public:
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Modifiers
-    T *Release() noexcept {
-        T *old = Get();
+    Pointer Release() noexcept {
+        Pointer old = Get();
         ptr_.GetFirst() = nullptr;
         return old;
     }
 
-    void Reset(T *ptr = nullptr) noexcept {
-        T *old_ptr = Get();
+    void Reset(Pointer ptr = nullptr) noexcept {
+        Pointer old_ptr = Get();
         ptr_.GetFirst() = ptr;
         if (old_ptr) {
             GetDeleter()(old_ptr);
@@ -198,7 +215,7 @@ public:
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Observers
-    T *Get() const noexcept {
+    Pointer Get() const noexcept {
         return ptr_.GetFirst();
     }
 
@@ -225,5 +242,30 @@ public:
     }
 
 private:
-    CompressedPair<T*, Deleter> ptr_;
-};
\ No newline at end of file
+    CompressedPair<Pointer, Deleter> ptr_;
+};
+
+template<typename T, typename... Args>
+std::enable_if_t<!std::is_array_v<T>, UniquePtr<T>> MakeUnique(Args &&... args) {
+    return UniquePtr<T>(new T(std::forward<Args>(args)...));
+}
+
+// `count` value-initialized elements.
+template<typename T>
+std::enable_if_t<std::is_array_v<T> && std::extent_v<T> == 0, UniquePtr<T>> MakeUnique(
+        size_t count) {
+    return UniquePtr<T>(new std::remove_extent_t<T>[count]());
+}
+
+// Like MakeUnique, but default-initializes: trivial types are left uninitialized,
+// e.g. for buffers that are about to be overwritten anyway.
+template<typename T>
+std::enable_if_t<!std::is_array_v<T>, UniquePtr<T>> MakeUniqueForOverwrite() {
+    return UniquePtr<T>(new T);
+}
+
+template<typename T>
+std::enable_if_t<std::is_array_v<T> && std::extent_v<T> == 0, UniquePtr<T>>
+MakeUniqueForOverwrite(size_t count) {
+    return UniquePtr<T>(new std::remove_extent_t<T>[count]);
+}
@@ -2,12 +2,12 @@
 
 #include "sw_fwd.h"  // Forward declaration
 
-template <typename T>
+template <typename T, typename Policy>
 class WeakPtr {
-    template <typename Y>
+    template <typename Y, typename P>
     friend class WeakPtr;
 
-    template <typename Y>
+    template <typename Y, typename P>
     friend class SharedPtr;
 
 public:
@@ -16,70 +16,70 @@ public:
     constexpr WeakPtr() noexcept : observed_(nullptr), block_(nullptr) {
     }
 
-    WeakPtr(const WeakPtr& other) noexcept : observed_(other.Lock().Get()), block_(other.block_) {
+    // Copies only take a weak reference: the pointer is carried over as is, even if
+    // the object is already dead, so it must not be converted through a virtual base.
+    WeakPtr(const WeakPtr& other) noexcept : observed_(other.observed_), block_(other.block_) {
         AddRef();
     }
 
     template <typename Y>
-    WeakPtr(const WeakPtr<Y>& other) noexcept
-            : observed_(other.Lock().Get()), block_(other.block_) {
+    WeakPtr(const WeakPtr<Y, Policy>& other) noexcept
+            : observed_(other.observed_), block_(other.block_) {
         AddRef();
     }
 
-    WeakPtr(const SharedPtr<T>& other) noexcept : observed_(other.observed_), block_(other.block_) {
+    WeakPtr(const SharedPtr<T, Policy>& other) noexcept
+            : observed_(other.observed_), block_(other.block_) {
         AddRef();
     }
 
     template <typename Y>
-    WeakPtr(const SharedPtr<Y>& other) noexcept : observed_(other.observed_), block_(other.block_) {
+    WeakPtr(const SharedPtr<Y, Policy>& other) noexcept
+            : observed_(other.observed_), block_(other.block_) {
         AddRef();
     }
 
-    WeakPtr(WeakPtr&& other) noexcept : observed_(other.Lock().Get()), block_(other.block_) {
-        AddRef();
-        other.Reset();
+    // Moves hand the reference over without touching the counts.
+    WeakPtr(WeakPtr&& other) noexcept
+            : observed_(std::exchange(other.observed_, nullptr)),
+              block_(std::exchange(other.block_, nullptr)) {
     }
 
     template <typename Y>
-    WeakPtr(WeakPtr&& other) noexcept : observed_(other.Lock().Get()), block_(other.block_) {
-        AddRef();
-        other.Reset();
+    WeakPtr(WeakPtr<Y, Policy>&& other) noexcept
+            : observed_(std::exchange(other.observed_, nullptr)),
+              block_(std::exchange(other.block_, nullptr)) {
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
     WeakPtr& operator=(const WeakPtr& other) {
-        WeakPtr<T>(other).Swap(*this);
+        WeakPtr(other).Swap(*this);
         return *this;
     }
 
     template <typename Y>
-    WeakPtr& operator=(const WeakPtr<Y>& other) {
-        WeakPtr<T>(other).Swap(*this);
+    WeakPtr& operator=(const WeakPtr<Y, Policy>& other) {
+        WeakPtr(other).Swap(*this);
         return *this;
     }
 
     WeakPtr& operator=(WeakPtr&& other) {
-        WeakPtr<T>(std::move(other)).Swap(*this);
+        WeakPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
     template <typename Y>
-    WeakPtr& operator=(WeakPtr<Y>&& other) {
-        WeakPtr<T>(std::move(other)).Swap(*this);
+    WeakPtr& operator=(WeakPtr<Y, Policy>&& other) {
+        WeakPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // Destructor
     ~WeakPtr() {
-        if (!block_) {
-            return;
-        }
-        block_->DecrementWeak();
-        if (block_->GetReferenceCount() == 0 && block_->GetWeakCount() == 0) {
-            delete block_;
-            return;
+        if (block_) {
+            block_->ReleaseWeak();
         }
     }
 
@@ -110,17 +110,22 @@ public:
         return block_->GetReferenceCount() == 0;
     }
 
-    SharedPtr<T> Lock() const {
-        return Expired() ? SharedPtr<T>() : SharedPtr<T>(*this);
+    SharedPtr<T, Policy> Lock() const noexcept {
+        SharedPtr<T, Policy> shared;
+        if (block_ && block_->IncrementIfNotZero()) {
+            shared.observed_ = observed_;
+            shared.block_ = block_;
+        }
+        return shared;
     }
 
     template <class Y>
-    bool OwnerBefore(const WeakPtr<Y>& other) const noexcept {
+    bool OwnerBefore(const WeakPtr<Y, Policy>& other) const noexcept {
         return block_ == other.block_;
     }
 
     template <class Y>
-    bool OwnerBefore(const SharedPtr<Y>& other) const noexcept {
+    bool OwnerBefore(const SharedPtr<Y, Policy>& other) const noexcept {
         return block_ == other.block_;
     }
 
@@ -131,6 +136,6 @@ private:
         }
     }
 
-    ControlBlockBase* block_;
-    T* observed_;
+    std::remove_extent_t<T>* observed_;
+    ControlBlockBase<Policy>* block_;
 };
\ No newline at end of file